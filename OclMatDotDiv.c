@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <math.h>
 
 // Define the OpenCL version
 #define CL_TARGET_OPENCL_VERSION 120
@@ -15,9 +16,39 @@
 #define MAX_SOURCE_SIZE (0x100000)
 
 // Define vector length
+#ifndef ROW
 #define ROW 4
+#endif
+#ifndef COL
 #define COL 4
+#endif
+#ifndef DEBUG
 #define DEBUG 1
+#endif
+// Division in the kernel (see mdd.cl): 0 exact, 1 native_divide,
+// 2 half_divide, 3 reciprocal plus one Newton step
+#ifndef DIV_MODE
+#define DIV_MODE 0
+#endif
+// 1: build with -cl-fast-relaxed-math -cl-mad-enable
+#ifndef FAST_MATH
+#define FAST_MATH 0
+#endif
+// Largest relative error accepted against exact division
+#ifndef TOLERANCE
+#if DIV_MODE == 2
+#define TOLERANCE 1e-3
+#elif DIV_MODE == 0 && !FAST_MATH
+#define TOLERANCE 1e-6
+#else
+#define TOLERANCE 1e-4
+#endif
+#endif
+// 1: divide every row of A by the row vector B (strided kernel, B has
+// only COL elements and is broadcast over the rows)
+#ifndef BROADCAST
+#define BROADCAST 0
+#endif
 
 int main() {
     // This code executes on the OpenCL host
@@ -29,17 +60,26 @@ int main() {
     
     // Compute the size of the data
     size_t datasize = sizeof(float)*ROW*COL;
+#if BROADCAST
+    size_t bsize = sizeof(float)*COL;
+#else
+    size_t bsize = datasize;
+#endif
+    // number of elements in B
+    int belems = (int)(bsize/sizeof(float));
     
     // Allocate space for input/output data
     A = (float*)malloc(datasize);
-    B = (float*)malloc(datasize);
+    B = (float*)malloc(bsize);
     C = (float*)malloc(datasize);
     
     // Initialize the input data
     for(int i = 0; i < ROW; i++) {
         for(int j = 0; j < COL; j++) {
             A[i*COL+j] = i*COL+j+1;
-            B[i*COL+j] = i*COL+j+1;
+            // quotients that are not exactly representable
+            if(i*COL+j < belems)
+                B[i*COL+j] = 1.0f + ((i*COL+j)*37 % 101) / 10.0f;
             C[i*COL+j] = 0;
         }
     }
@@ -51,7 +91,7 @@ int main() {
         printf("\n");
     }
     printf("\n");
-    for(int i = 0; i < ROW; i++) {
+    for(int i = 0; i < belems/COL; i++) {
         for(int j = 0; j < COL; j++) {
             printf("B[%d][%d]=%f\t", i, j, B[i*COL+j]);
         }
@@ -166,7 +206,7 @@ int main() {
     cmdQueue = clCreateCommandQueue(
                                     context,
                                     devices[0],
-                                    0,
+                                    CL_QUEUE_PROFILING_ENABLE,
                                     &status);
     if(status==CL_SUCCESS){
         printf("clCreateCommandQueue done!\n");
@@ -203,7 +243,7 @@ int main() {
     bufferB = clCreateBuffer(
                              context,
                              CL_MEM_READ_ONLY,
-                             datasize,
+                             bsize,
                              NULL,
                              &status);
     if(status==CL_SUCCESS){
@@ -252,7 +292,7 @@ int main() {
                                   bufferB,
                                   CL_FALSE,
                                   0,
-                                  datasize,
+                                  bsize,
                                   B,
                                   0,
                                   NULL,
@@ -289,12 +329,16 @@ int main() {
     }
     
     // Build (compile) the program for the devices with
-    // clBuildProgram()
+    // clBuildProgram(), selecting the division mode
+    char options[128];
+    snprintf(options, sizeof(options), "-DDIV_MODE=%d%s", DIV_MODE,
+             FAST_MATH ? " -cl-fast-relaxed-math -cl-mad-enable" : "");
+    printf("build options: %s\n", options);
     status = clBuildProgram(
                             program,
                             numDevices,
                             devices,
-                            NULL,
+                            options,
                             NULL,
                             NULL);
     if(status==CL_SUCCESS){
@@ -317,7 +361,11 @@ int main() {
     
     // Use clCreateKernel() to create a kernel from the
     // vector addition function (named "vecadd")
+#if BROADCAST
+    kernel = clCreateKernel(program, "matrix_dot_div_view", &status);
+#else
     kernel = clCreateKernel(program, "matrix_dot_div", &status);
+#endif
     if(status==CL_SUCCESS){
         printf("clCreateKernel done!\n");
     }else{
@@ -333,6 +381,24 @@ int main() {
     // kernel
     // using clSetKernelArg()
     int RowSize = ROW, ColSize = COL;
+#if BROADCAST
+    // offset, row stride and column stride of A, B and C;
+    // B's row stride of 0 repeats its only row
+    int viewA[3] = {0, COL, 1};
+    int viewB[3] = {0, 0, 1};
+    int viewC[3] = {0, COL, 1};
+    status  = clSetKernelArg(kernel, 0, sizeof(int), (void*)&RowSize);
+    status |= clSetKernelArg(kernel, 1, sizeof(int), (void*)&ColSize);
+    status |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &bufferA);
+    for(int k = 0; k < 3; k++)
+        status |= clSetKernelArg(kernel, 3+k, sizeof(int), (void*)&viewA[k]);
+    status |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &bufferB);
+    for(int k = 0; k < 3; k++)
+        status |= clSetKernelArg(kernel, 7+k, sizeof(int), (void*)&viewB[k]);
+    status |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &bufferC);
+    for(int k = 0; k < 3; k++)
+        status |= clSetKernelArg(kernel, 11+k, sizeof(int), (void*)&viewC[k]);
+#else
     status  = clSetKernelArg(
                              kernel,
                              0,
@@ -358,6 +424,7 @@ int main() {
                              4,
                              sizeof(cl_mem),
                              &bufferC);
+#endif
     if(status==CL_SUCCESS){
         printf("clSetKernelArg done!\n");
     }else{
@@ -376,9 +443,10 @@ int main() {
     // but can be used.
     float gloablWorkDim = 2;
     size_t globalWorkSize[2];
-    // There are '2D' work-items
-    globalWorkSize[0] = ROW;
-    globalWorkSize[1] = COL;
+    // There are '2D' work-items; both kernels take the column from
+    // dimension 0
+    globalWorkSize[0] = COL;
+    globalWorkSize[1] = ROW;
     
     //-----------------------------------------------------
     // STEP 11: Enqueue the kernel for execution
@@ -388,6 +456,7 @@ int main() {
     // clEnqueueNDRangeKernel().
     // 'globalWorkSize' is the 1D dimension of the
     // work-items
+    cl_event event;
     status = clEnqueueNDRangeKernel(
                                     cmdQueue,
                                     kernel,
@@ -397,7 +466,7 @@ int main() {
                                     NULL,
                                     0,
                                     NULL,
-                                    NULL);
+                                    &event);
     if(status==CL_SUCCESS){
         printf("clEnqueueNDRangeKernel done!\n");
     }else{
@@ -405,6 +474,14 @@ int main() {
         exit(1);
     }
     
+    // Time the kernel alone from the profiling information
+    cl_ulong start, end;
+    clWaitForEvents(1, &event);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+    printf("kernel time: %f msec\n", (end - start) / 1000000.0);
+    clReleaseEvent(event);
+    
     //-----------------------------------------------------
     // STEP 12: Read the output buffer back to the host
     //-----------------------------------------------------
@@ -423,20 +500,31 @@ int main() {
                         NULL,
                         NULL);
     
-    // Verify the output
+    // Verify the output against exact division, in double
     bool result = true;
+    double maxErr = 0.0, sumErr = 0.0;
     for(int i = 0; i < ROW; i++) {
         for(int j=0;j<COL;j++){
+#if BROADCAST
+            double expected = (double)A[i*COL+j]/B[j];
+#else
+            double expected = (double)A[i*COL+j]/B[i*COL+j];
+#endif
+            double err = fabs(C[i*COL+j] - expected) / fabs(expected);
 #if DEBUG
             printf("C[%d][%d]=%f - %f\n",
-                   i,j,C[i*COL+j],(float)(i*COL+j+1)/(i*COL+j+1));
+                   i,j,C[i*COL+j],expected);
 #endif
-            if((int)C[i*COL+j] != (i*COL+j+1)/(i*COL+j+1)) {
-                result = false;
-                break;
-            }
+            if(err > maxErr)
+                maxErr = err;
+            sumErr += err;
         }
     }
+    // the tolerance depends on DIV_MODE and FAST_MATH, see above
+    if(maxErr > TOLERANCE)
+        result = false;
+    printf("relative error: max %e, mean %e (tolerance %e)\n",
+           maxErr, sumErr / (ROW*COL), TOLERANCE);
     if(result) {
         printf("Output is correct\n");
     } else {
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "binio.h"
+
+static const int advice_flags[] = {
+  MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED, MADV_DONTNEED
+};
+
+size_t binioElementSize( binio_dtype dtype)
+{
+  switch (dtype) {
+  case BINIO_FLOAT32: return 4;
+  case BINIO_FLOAT64: return 8;
+  case BINIO_INT32:   return 4;
+  case BINIO_INT64:   return 8;
+  case BINIO_UINT8:   return 1;
+  case BINIO_UINT32:  return 4;
+  }
+  return 0;
+}
+
+static size_t pageSize( void)
+{
+  return (size_t) sysconf( _SC_PAGESIZE);
+}
+
+size_t binioCount( const binio_array *arr)
+{
+  size_t n = 1;
+
+  for (uint32_t k = 0; k < arr->hdr.ndims; k++)
+    n *= arr->hdr.dims[k];
+  return n;
+}
+
+int binioIsDense( const binio_array *arr)
+{
+  int64_t s = 1;
+
+  for (int k = (int) arr->hdr.ndims - 1; k >= 0; k--) {
+    if (arr->hdr.dims[k] != 1 && arr->hdr.strides[k] != s)
+      return 0;
+    s *= (int64_t) arr->hdr.dims[k];
+  }
+  return 1;
+}
+
+/* Rejects headers we cannot map safely: foreign byte order, unknown
+ * dtype, or elements reachable through the strides that lie beyond
+ * data_bytes or the end of the file.  */
+static int checkHeader( const binio_header *h, size_t file_bytes)
+{
+  uint64_t es, last = 0, step, end;
+
+  if (memcmp( h->magic, BINIO_MAGIC, sizeof (h->magic)) != 0
+      || h->version != BINIO_VERSION || h->endian != BINIO_ENDIAN
+      || h->ndims > BINIO_MAX_DIMS || h->align == 0 || (h->align & (h->align - 1)) != 0
+      || h->data_offset < sizeof (binio_header) || h->data_offset % h->align != 0
+      || h->data_offset > file_bytes || h->data_bytes > file_bytes - h->data_offset)
+    return -1;
+  es = binioElementSize( (binio_dtype) h->dtype);
+  if (es == 0)
+    return -1;
+
+  for (uint32_t k = 0; k < h->ndims; k++) {
+    if (h->dims[k] == 0)
+      return 0;
+    if (h->strides[k] < 0)
+      return -1;
+    /* a crafted header must not wrap these past the check below */
+    if (__builtin_mul_overflow( h->dims[k] - 1, (uint64_t) h->strides[k], &step)
+        || __builtin_add_overflow( last, step, &last))
+      return -1;
+  }
+  if (__builtin_add_overflow( last, 1, &end) || __builtin_mul_overflow( end, es, &end)
+      || end > h->data_bytes)
+    return -1;
+  return 0;
+}
+
+int binioCreate( const char *path, binio_dtype dtype, int ndims, const size_t *dims,
+                 size_t align, binio_array *arr)
+{
+  binio_header *h = &arr->hdr;
+  size_t es = binioElementSize( dtype);
+  int64_t s = 1;
+
+  memset( arr, 0, sizeof (binio_array));
+  arr->fd = -1;
+  if (es == 0 || ndims < 0 || ndims > BINIO_MAX_DIMS) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (align == 0)
+    align = pageSize();
+  if ((align & (align - 1)) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memcpy( h->magic, BINIO_MAGIC, sizeof (h->magic));
+  h->version = BINIO_VERSION;
+  h->endian = BINIO_ENDIAN;
+  h->dtype = dtype;
+  h->ndims = ndims;
+  h->align = align;
+  h->data_offset = (sizeof (binio_header) + align - 1) & ~(uint64_t)(align - 1);
+  for (int k = ndims - 1; k >= 0; k--) {
+    h->dims[k] = dims[k];
+    h->strides[k] = s;
+    if (dims[k] > INT64_MAX || __builtin_mul_overflow( s, (int64_t) dims[k], &s)) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  /* the whole file must still fit an off_t */
+  if (__builtin_mul_overflow( (uint64_t) s, (uint64_t) es, &h->data_bytes)
+      || h->data_bytes > (uint64_t) INT64_MAX - h->data_offset) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  arr->fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (arr->fd < 0)
+    return -1;
+  arr->writable = 1;
+  arr->map_bytes = h->data_offset + h->data_bytes;
+  /* the file stays sparse until the pages are written */
+  if (ftruncate( arr->fd, (off_t) arr->map_bytes) != 0)
+    goto fail;
+  arr->map = mmap( NULL, arr->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, arr->fd, 0);
+  if (arr->map == MAP_FAILED)
+    goto fail;
+  memcpy( arr->map, h, sizeof (binio_header));
+  arr->data = (char *) arr->map + h->data_offset;
+  return 0;
+
+fail:
+  close( arr->fd);
+  arr->fd = -1;
+  arr->map = NULL;
+  return -1;
+}
+
+int binioOpen( const char *path, int writable, binio_array *arr)
+{
+  struct stat st;
+  int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+
+  memset( arr, 0, sizeof (binio_array));
+  arr->fd = open( path, writable ? O_RDWR : O_RDONLY);
+  if (arr->fd < 0)
+    return -1;
+  arr->writable = writable;
+  if (fstat( arr->fd, &st) != 0)
+    goto fail;
+  if ((size_t) st.st_size < sizeof (binio_header)) {
+    errno = EINVAL;
+    goto fail;
+  }
+  arr->map_bytes = (size_t) st.st_size;
+  arr->map = mmap( NULL, arr->map_bytes, prot, MAP_SHARED, arr->fd, 0);
+  if (arr->map == MAP_FAILED)
+    goto fail;
+  memcpy( &arr->hdr, arr->map, sizeof (binio_header));
+  if (checkHeader( &arr->hdr, arr->map_bytes) != 0) {
+    munmap( arr->map, arr->map_bytes);
+    errno = EINVAL;
+    goto fail;
+  }
+  arr->data = (char *) arr->map + arr->hdr.data_offset;
+  return 0;
+
+fail:
+  close( arr->fd);
+  arr->fd = -1;
+  arr->map = NULL;
+  return -1;
+}
+
+int binioAdvise( binio_array *arr, size_t offset, size_t len, binio_advice advice)
+{
+  size_t page = pageSize();
+  size_t start, end;
+
+  if (advice < BINIO_NORMAL || advice > BINIO_DONTNEED || offset > arr->hdr.data_bytes) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (len == 0 || len > arr->hdr.data_bytes - offset)
+    len = arr->hdr.data_bytes - offset;
+  if (len == 0)
+    return 0;
+
+  /* madvise wants a page aligned start */
+  start = (arr->hdr.data_offset + offset) & ~(page - 1);
+  end = arr->hdr.data_offset + offset + len;
+  return madvise( (char *) arr->map + start, end - start, advice_flags[advice]);
+}
+
+int binioSync( binio_array *arr)
+{
+  if (!arr->writable)
+    return 0;
+  return msync( arr->map, arr->map_bytes, MS_SYNC);
+}
+
+void binioClose( binio_array *arr)
+{
+  if (arr->map != NULL)
+    munmap( arr->map, arr->map_bytes);
+  if (arr->fd >= 0)
+    close( arr->fd);
+  arr->map = NULL;
+  arr->data = NULL;
+  arr->fd = -1;
+}
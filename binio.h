@@ -0,0 +1,92 @@
+#ifndef BINIO_H
+#define BINIO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Self-describing binary arrays on disk, accessed through mmap.
+ *
+ * A file is a fixed binio_header followed, at data_offset, by the
+ * elements. data_offset is a multiple of the header's alignment (the page
+ * size by default), so the mapped data can back a CL_MEM_USE_HOST_PTR
+ * buffer (binio_cl.h) or be handed to host kernels directly: nothing is
+ * read into malloc'ed memory and nothing is copied a second time. Pages
+ * are only faulted in when the device or the host touches them.
+ *
+ *   binio_array a;
+ *   if (binioOpen( "a.bin", 0, &a) == 0) {
+ *     binioAdvise( &a, 0, 0, BINIO_SEQUENTIAL);
+ *     d_a = binioBuffer( context, &a, CL_MEM_READ_ONLY, &err);
+ *     ...
+ *     clReleaseMemObject( d_a);
+ *     binioClose( &a);
+ *   }
+ *
+ * All functions return 0 on success and -1 on failure (with errno set for
+ * system errors, EINVAL for a malformed or foreign-endian header).
+ */
+
+#define BINIO_MAGIC "DPTARRAY"
+#define BINIO_VERSION 1
+#define BINIO_ENDIAN 0x01020304u
+#define BINIO_MAX_DIMS 8
+
+typedef enum {
+  BINIO_FLOAT32, BINIO_FLOAT64, BINIO_INT32, BINIO_INT64, BINIO_UINT8, BINIO_UINT32
+} binio_dtype;
+
+typedef enum {
+  BINIO_NORMAL, BINIO_SEQUENTIAL, BINIO_RANDOM, BINIO_WILLNEED, BINIO_DONTNEED
+} binio_advice;
+
+/* on-disk layout, 176 bytes, native byte order (checked via endian) */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint32_t dtype;
+  uint32_t ndims;
+  uint64_t align;                       /* of data_offset, power of two */
+  uint64_t data_offset;                 /* from the start of the file */
+  uint64_t data_bytes;                  /* extent of the elements */
+  uint64_t dims[BINIO_MAX_DIMS];
+  int64_t strides[BINIO_MAX_DIMS];      /* in elements */
+} binio_header;
+
+typedef struct {
+  binio_header hdr;
+  int fd;
+  int writable;
+  void *map;                            /* whole file */
+  size_t map_bytes;
+  void *data;                           /* map + data_offset */
+} binio_array;
+
+size_t binioElementSize( binio_dtype dtype);
+
+/* Creates (truncates) path for a dense row-major array of the given shape
+ * and maps it read-write; the elements are zero until written. align 0
+ * means the page size.  */
+int binioCreate( const char *path, binio_dtype dtype, int ndims, const size_t *dims,
+                 size_t align, binio_array *arr);
+
+/* maps an existing file, read-only unless writable */
+int binioOpen( const char *path, int writable, binio_array *arr);
+
+/* number of elements, product of the dims */
+size_t binioCount( const binio_array *arr);
+
+/* 1 if the strides are the dense row-major ones */
+int binioIsDense( const binio_array *arr);
+
+/* madvise() for len bytes of the data starting at offset (len 0: to the
+ * end). Streaming consumers advise BINIO_SEQUENTIAL once and may drop
+ * what they have finished with by BINIO_DONTNEED.  */
+int binioAdvise( binio_array *arr, size_t offset, size_t len, binio_advice advice);
+
+/* writes dirty pages of a writable array back to the file */
+int binioSync( binio_array *arr);
+
+void binioClose( binio_array *arr);
+
+#endif
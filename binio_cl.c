@@ -0,0 +1,28 @@
+#include "binio_cl.h"
+
+cl_mem binioBuffer( cl_context context, binio_array *arr, cl_mem_flags flags, cl_int *err)
+{
+  /* the device must not write into a read-only mapping */
+  if (!arr->writable && (flags & (CL_MEM_WRITE_ONLY | CL_MEM_READ_WRITE))) {
+    *err = CL_INVALID_VALUE;
+    return NULL;
+  }
+  if (!arr->writable)
+    flags |= CL_MEM_READ_ONLY;
+  return clCreateBuffer( context, flags | CL_MEM_USE_HOST_PTR,
+                         arr->hdr.data_bytes, arr->data, err);
+}
+
+cl_int binioMapResults( cl_command_queue queue, cl_mem buf, binio_array *arr)
+{
+  cl_int err;
+  void *p;
+
+  p = clEnqueueMapBuffer( queue, buf, CL_TRUE, CL_MAP_READ, 0, arr->hdr.data_bytes,
+                          0, NULL, NULL, &err);
+  if (err != CL_SUCCESS)
+    return err;
+  /* with CL_MEM_USE_HOST_PTR the mapping is the host memory itself; an
+   * implementation that cached the buffer elsewhere has copied it back */
+  return clEnqueueUnmapMemObject( queue, buf, p, 0, NULL, NULL);
+}
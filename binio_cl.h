@@ -0,0 +1,24 @@
+#ifndef BINIO_CL_H
+#define BINIO_CL_H
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "binio.h"
+
+/* OpenCL buffers over binio arrays. Kept apart from binio.c so that host
+ * programs using binio files do not need an OpenCL library.  */
+
+/* A buffer over the mapped elements (flags | CL_MEM_USE_HOST_PTR). The
+ * array must stay mapped as long as the buffer exists. Device writes are
+ * only guaranteed to be visible in the mapping after clEnqueueMapBuffer,
+ * see binioMapResults().  */
+cl_mem binioBuffer( cl_context context, binio_array *arr, cl_mem_flags flags, cl_int *err);
+
+/* makes the device's writes to a binioBuffer visible in the mapping */
+cl_int binioMapResults( cl_command_queue queue, cl_mem buf, binio_array *arr);
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "timer.h"
+#include "binio_cl.h"
+#include "fuse.h"
+
+/* Computes sqrt(|a|) of a float matrix stored in a binio file, writing
+ * the result to <file>.out. The input is loaded once the usual way
+ * (fread into malloc'ed memory, then copied into a device buffer) and
+ * once through the mapping, which the device reads directly.
+ *
+ * usage: binio_demo file [rows cols [cpu]]
+ *   with rows and cols, file is (re)created first
+ */
+
+#define die(msg, ...) do {                      \
+  (void) fprintf (stderr, msg, ## __VA_ARGS__); \
+  (void) fprintf (stderr, "\n");                \
+} while (0)
+
+int startsec, startnsec, stopsec, stopnsec;
+
+void printTimeElapsed( char *text)
+{
+  double elapsed = (stopsec -startsec)*1000.0
+                  + (double)(stopnsec -startnsec)/1000000.0;
+  printf( "%s: %f msec\n", text, elapsed);
+}
+
+int createInput( const char *path, size_t rows, size_t cols)
+{
+  size_t dims[2] = { rows, cols };
+  binio_array a;
+  float *p;
+
+  if (binioCreate( path, BINIO_FLOAT32, 2, dims, 0, &a) != 0)
+    return -1;
+  binioAdvise( &a, 0, 0, BINIO_SEQUENTIAL);
+  p = (float *) a.data;
+  for (size_t i = 0; i < rows*cols; i++)
+    p[i] = rand () / (float) RAND_MAX - 0.5f;
+  binioSync( &a);
+  binioClose( &a);
+  return 0;
+}
+
+int main (int argc, char * argv[])
+{
+  if (argc < 2) {
+    die( "usage: binio_demo file [rows cols [cpu]]");
+    return 1;
+  }
+  const char *path = argv[1];
+  int devType = (argc > 4 ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU);
+  char out_path[1024];
+  binio_array in, out;
+  cl_platform_id platform;
+  cl_device_id device_id;
+  cl_context context;
+  cl_command_queue commands;
+  cl_mem d_in, d_out;
+  cl_int err;
+  size_t dims[BINIO_MAX_DIMS];
+  size_t count, bytes, correct;
+  float *copy, *a, *r;
+
+  if (argc > 3) {
+    TIMERwc_time( &startsec, &startnsec);
+    if (createInput( path, atol( argv[2]), atol( argv[3])) != 0) {
+      die( "Error: cannot create %s!", path);
+      return 1;
+    }
+    TIMERwc_time( &stopsec, &stopnsec);
+    printTimeElapsed( "creating the input");
+  }
+
+  if (binioOpen( path, 0, &in) != 0) {
+    die( "Error: %s is not a binio array!", path);
+    return 1;
+  }
+  if (in.hdr.dtype != BINIO_FLOAT32 || !binioIsDense( &in)) {
+    die( "Error: %s is not a dense float array!", path);
+    binioClose( &in);
+    return 1;
+  }
+  count = binioCount( &in);
+  bytes = in.hdr.data_bytes;
+  printf( "%lu elements, %lu bytes\n", (unsigned long)count, (unsigned long)bytes);
+
+  for (uint32_t k = 0; k < in.hdr.ndims; k++)
+    dims[k] = in.hdr.dims[k];
+  snprintf( out_path, sizeof (out_path), "%s.out", path);
+  if (binioCreate( out_path, BINIO_FLOAT32, in.hdr.ndims, dims, 0, &out) != 0) {
+    die( "Error: cannot create %s!", out_path);
+    binioClose( &in);
+    return 1;
+  }
+
+  err = clGetPlatformIDs (1, &platform, NULL);
+  err |= clGetDeviceIDs (platform, devType, 1, &device_id, NULL);
+  if (err != CL_SUCCESS) {
+    die( "Error: Failed to find a device!");
+    return 1;
+  }
+  context = clCreateContext (0, 1, &device_id, NULL, NULL, &err);
+  commands = clCreateCommandQueue (context, device_id, 0, &err);
+  fuseSetDevice( context, device_id, commands);
+
+  /* the usual way: read into malloc'ed memory, copy into the buffer */
+  TIMERwc_time( &startsec, &startnsec);
+  copy = (float *) malloc (bytes);
+  FILE *f = fopen( path, "rb");
+  if (f == NULL || fseek( f, (long) in.hdr.data_offset, SEEK_SET) != 0
+      || fread( copy, 1, bytes, f) != bytes) {
+    die( "Error: cannot read %s!", path);
+    return 1;
+  }
+  fclose( f);
+  d_in = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, copy, &err);
+  d_out = clCreateBuffer (context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
+  err = fuseEval( fuseSqrt( fuseAbs( fuseBuffer( d_in, count, FUSE_FLOAT))), d_out);
+  err |= clEnqueueReadBuffer (commands, d_out, CL_TRUE, 0, bytes, out.data, 0, NULL, NULL);
+  TIMERwc_time( &stopsec, &stopnsec);
+  fuseReset();
+  if (err != CL_SUCCESS)
+    die( "Error: evaluation on copies failed!");
+  printTimeElapsed( "fread + copy to device + read back (incl. build)");
+  clReleaseMemObject (d_in);
+  clReleaseMemObject (d_out);
+  free( copy);
+  memset( out.data, 0, bytes);
+
+  /* through the mappings, no intermediate copies on the host */
+  TIMERwc_time( &startsec, &startnsec);
+  binioAdvise( &in, 0, 0, BINIO_SEQUENTIAL);
+  d_in = binioBuffer( context, &in, CL_MEM_READ_ONLY, &err);
+  d_out = binioBuffer( context, &out, CL_MEM_WRITE_ONLY, &err);
+  err = fuseEval( fuseSqrt( fuseAbs( fuseBuffer( d_in, count, FUSE_FLOAT))), d_out);
+  err |= binioMapResults( commands, d_out, &out);
+  TIMERwc_time( &stopsec, &stopnsec);
+  fuseReset();
+  if (err != CL_SUCCESS)
+    die( "Error: evaluation on mappings failed!");
+  printTimeElapsed( "mapped input and output");
+
+  a = (float *) in.data;
+  r = (float *) out.data;
+  correct = 0;
+  for (size_t i = 0; i < count; i++)
+    if (fabsf( r[i] - sqrtf( fabsf( a[i]))) <= 1e-6f * sqrtf( fabsf( a[i])))
+      correct++;
+  printf ("Computed %lu/%lu correct values\n", (unsigned long)correct, (unsigned long)count);
+
+  fuseRelease();
+  clReleaseMemObject (d_in);
+  clReleaseMemObject (d_out);
+  clReleaseCommandQueue (commands);
+  clReleaseContext (context);
+  binioSync( &out);
+  binioClose( &out);
+  binioClose( &in);
+
+  return 0;
+}
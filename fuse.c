@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "fuse.h"
+
+typedef struct fuse_program {
+  unsigned long hash;
+  char *source;
+  cl_program program;
+  cl_kernel kernel;
+  struct fuse_program *next;
+} fuse_program;
+
+/* growing source text */
+typedef struct {
+  char *text;
+  size_t len, size;
+} fuse_source;
+
+/* operands of one generated kernel, in argument order */
+typedef struct {
+  fuse_node **bufs;
+  int num_bufs;
+  fuse_node **scalars;
+  int num_scalars;
+  int num_temps;
+  int dense;                    /* all operands dense and of full shape */
+} fuse_args;
+
+static fuse_node *nodes = NULL;
+static fuse_program *programs = NULL;
+
+static cl_context context = NULL;
+static cl_device_id device = NULL;
+static cl_command_queue queue = NULL;
+
+/* preferred vector widths and number of compute units of the device */
+static cl_uint width_float = 1, width_double = 1;
+static cl_uint compute_units = 1;
+
+#define FUSE_LOCAL 64
+#define FUSE_GROUPS_PER_UNIT 8
+
+static cl_uint clampWidth( cl_uint w)
+{
+  /* vloadn/vstoren exist for 2, 4, 8 and 16 */
+  if (w >= 16) return 16;
+  if (w >= 8) return 8;
+  if (w >= 4) return 4;
+  if (w >= 2) return 2;
+  return 1;
+}
+
+void fuseSetDevice( cl_context ctx, cl_device_id dev, cl_command_queue q)
+{
+  if (ctx != context || dev != device)
+    fuseRelease();
+  context = ctx;
+  device = dev;
+  queue = q;
+
+  width_float = width_double = compute_units = 1;
+  clGetDeviceInfo (dev, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof (cl_uint), &width_float, NULL);
+  clGetDeviceInfo (dev, CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE, sizeof (cl_uint), &width_double, NULL);
+  clGetDeviceInfo (dev, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof (cl_uint), &compute_units, NULL);
+  width_float = clampWidth( width_float);
+  width_double = clampWidth( width_double);
+  if (compute_units == 0)
+    compute_units = 1;
+}
+
+unsigned int fuseVectorWidth( fuse_type type)
+{
+  return (type == FUSE_DOUBLE ? width_double : width_float);
+}
+
+static fuse_node *newNode( fuse_op op, fuse_node *a, fuse_node *b)
+{
+  fuse_node *node = (fuse_node *) calloc (1, sizeof (fuse_node));
+
+  node->op = op;
+  node->a = a;
+  node->b = b;
+  node->rows = node->cols = 1;
+  if (a != NULL) {
+    /* scalars take the type of the other operand, shapes broadcast */
+    node->type = (a->op == FUSE_SCALAR && b != NULL ? b->type : a->type);
+    node->rows = a->rows;
+    node->cols = a->cols;
+    if (b != NULL && a->rows == 1)
+      node->rows = b->rows;
+    if (b != NULL && a->cols == 1)
+      node->cols = b->cols;
+  }
+  node->next = nodes;
+  nodes = node;
+  return node;
+}
+
+fuse_node *fuseView( cl_mem buf, size_t rows, size_t cols,
+                     long row_stride, long col_stride, size_t offset, fuse_type type)
+{
+  fuse_node *node = newNode( FUSE_BUFFER, NULL, NULL);
+
+  node->buf = buf;
+  node->rows = rows;
+  node->cols = cols;
+  node->rs = row_stride;
+  node->cs = col_stride;
+  node->offset = offset;
+  node->type = type;
+  return node;
+}
+
+fuse_node *fuseBuffer( cl_mem buf, size_t n, fuse_type type)
+{
+  return fuseView( buf, 1, n, n, 1, 0, type);
+}
+
+fuse_node *fuseScalar( double val)
+{
+  fuse_node *node = newNode( FUSE_SCALAR, NULL, NULL);
+
+  node->val = val;
+  node->type = FUSE_FLOAT;
+  return node;
+}
+
+fuse_node *fuseAdd( fuse_node *a, fuse_node *b) { return newNode( FUSE_ADD, a, b); }
+fuse_node *fuseSub( fuse_node *a, fuse_node *b) { return newNode( FUSE_SUB, a, b); }
+fuse_node *fuseMul( fuse_node *a, fuse_node *b) { return newNode( FUSE_MUL, a, b); }
+fuse_node *fuseDiv( fuse_node *a, fuse_node *b) { return newNode( FUSE_DIV, a, b); }
+fuse_node *fuseMin( fuse_node *a, fuse_node *b) { return newNode( FUSE_MIN, a, b); }
+fuse_node *fuseMax( fuse_node *a, fuse_node *b) { return newNode( FUSE_MAX, a, b); }
+
+fuse_node *fuseNeg( fuse_node *a)  { return newNode( FUSE_NEG, a, NULL); }
+fuse_node *fuseSqr( fuse_node *a)  { return newNode( FUSE_SQR, a, NULL); }
+fuse_node *fuseSqrt( fuse_node *a) { return newNode( FUSE_SQRT, a, NULL); }
+fuse_node *fuseExp( fuse_node *a)  { return newNode( FUSE_EXP, a, NULL); }
+fuse_node *fuseLog( fuse_node *a)  { return newNode( FUSE_LOG, a, NULL); }
+fuse_node *fuseAbs( fuse_node *a)  { return newNode( FUSE_ABS, a, NULL); }
+
+static void append( fuse_source *src, const char *fmt, ...)
+{
+  va_list ap;
+  int len;
+
+  va_start( ap, fmt);
+  len = vsnprintf( NULL, 0, fmt, ap);
+  va_end( ap);
+  if (src->len + len + 1 > src->size) {
+    src->size = 2 * (src->len + len + 1);
+    src->text = (char *) realloc (src->text, src->size);
+  }
+  va_start( ap, fmt);
+  vsnprintf( src->text + src->len, len + 1, fmt, ap);
+  va_end( ap);
+  src->len += len;
+}
+
+static int sameView( fuse_node *a, fuse_node *b)
+{
+  return a->buf == b->buf && a->rows == b->rows && a->cols == b->cols
+         && a->rs == b->rs && a->cs == b->cs && a->offset == b->offset;
+}
+
+static int bufferArg( fuse_args *args, fuse_node *node)
+{
+  for (int k = 0; k < args->num_bufs; k++)
+    if (sameView( args->bufs[k], node))
+      return k;
+  return -1;
+}
+
+/* dense row-major rows x cols, so that element (r,c) is at r*cols+c */
+static int isDense( size_t rows, size_t cols, long rs, long cs, size_t offset)
+{
+  return offset == 0 && cs == 1 && (rows == 1 || rs == (long) cols);
+}
+
+static int scalarArg( fuse_args *args, fuse_node *node)
+{
+  for (int k = 0; k < args->num_scalars; k++)
+    if (args->scalars[k] == node)
+      return k;
+  return -1;
+}
+
+/* Checks operand shapes and types, numbers the nodes in post order and
+ * collects the kernel operands. Returns CL_SUCCESS or an error.  */
+static cl_int collect( fuse_node *node, fuse_args *args, fuse_type type, size_t rows, size_t cols)
+{
+  cl_int err;
+
+  if (node->id >= 0)
+    return CL_SUCCESS;            /* shared sub-expression, already done */
+
+  switch (node->op) {
+    case FUSE_BUFFER:
+      if ((node->rows != rows && node->rows != 1) || (node->cols != cols && node->cols != 1))
+        return CL_INVALID_BUFFER_SIZE;
+      if (node->type != type)
+        return CL_INVALID_VALUE;
+      /* several leaves may read the same view; pass it only once */
+      if (bufferArg( args, node) < 0)
+        args->bufs[args->num_bufs++] = node;
+      if (node->rows != rows || node->cols != cols
+          || !isDense( node->rows, node->cols, node->rs, node->cs, node->offset))
+        args->dense = 0;
+      break;
+    case FUSE_SCALAR:
+      args->scalars[args->num_scalars++] = node;
+      break;
+    default:
+      if ((err = collect( node->a, args, type, rows, cols)) != CL_SUCCESS)
+        return err;
+      if (node->b != NULL && (err = collect( node->b, args, type, rows, cols)) != CL_SUCCESS)
+        return err;
+  }
+  node->id = args->num_temps++;
+  return CL_SUCCESS;
+}
+
+enum { EMIT_SCALAR, EMIT_VECTOR, EMIT_STRIDED };
+
+/* One statement per node, in post order. EMIT_VECTOR statements work on
+ * TV vectors loaded with VLOAD at i, EMIT_SCALAR ones on element i and
+ * EMIT_STRIDED ones on element (r,c) of each operand's view.  */
+static void emitNode( fuse_source *src, fuse_node *node, fuse_args *args, int *done, int mode)
+{
+  const char *type = (mode == EMIT_VECTOR ? "TV" : "T");
+  int t = node->id;
+
+  if (done[t])
+    return;
+  done[t] = 1;
+  if (node->a != NULL)
+    emitNode( src, node->a, args, done, mode);
+  if (node->b != NULL)
+    emitNode( src, node->b, args, done, mode);
+
+  /* leaves reading an already loaded view reuse that value */
+  if (node->op == FUSE_BUFFER) {
+    fuse_node *first = args->bufs[bufferArg( args, node)];
+
+    if (first != node) {
+      emitNode( src, first, args, done, mode);
+      append( src, "     %s t%d = t%d;\n", type, t, first->id);
+      return;
+    }
+  }
+
+  append( src, "     %s t%d = ", type, t);
+  switch (node->op) {
+    case FUSE_BUFFER:
+      if (mode == EMIT_VECTOR)
+        append( src, "VLOAD( i, in%d);\n", bufferArg( args, node));
+      else if (mode == EMIT_SCALAR)
+        append( src, "in%d[i];\n", bufferArg( args, node));
+      else {
+        int k = bufferArg( args, node);
+        append( src, "in%d[off%d + (long)r*rs%d + (long)c*cs%d];\n", k, k, k, k);
+      }
+      break;
+    case FUSE_SCALAR: append( src, "(%s)(s%d);\n", type, scalarArg( args, node)); break;
+    case FUSE_ADD:    append( src, "t%d + t%d;\n", node->a->id, node->b->id); break;
+    case FUSE_SUB:    append( src, "t%d - t%d;\n", node->a->id, node->b->id); break;
+    case FUSE_MUL:    append( src, "t%d * t%d;\n", node->a->id, node->b->id); break;
+    case FUSE_DIV:    append( src, "t%d / t%d;\n", node->a->id, node->b->id); break;
+    case FUSE_MIN:    append( src, "fmin( t%d, t%d);\n", node->a->id, node->b->id); break;
+    case FUSE_MAX:    append( src, "fmax( t%d, t%d);\n", node->a->id, node->b->id); break;
+    case FUSE_NEG:    append( src, "-t%d;\n", node->a->id); break;
+    case FUSE_SQR:    append( src, "t%d * t%d;\n", node->a->id, node->a->id); break;
+    case FUSE_SQRT:   append( src, "sqrt( t%d);\n", node->a->id); break;
+    case FUSE_EXP:    append( src, "exp( t%d);\n", node->a->id); break;
+    case FUSE_LOG:    append( src, "log( t%d);\n", node->a->id); break;
+    case FUSE_ABS:    append( src, "fabs( t%d);\n", node->a->id); break;
+  }
+}
+
+/* The kernel walks the data with a grid-stride loop, so a fixed number of
+ * work-groups covers any n: first W elements at a time with vloadW and
+ * vstoreW, then the n % W remaining elements as scalars.  */
+static void generate( fuse_source *src, fuse_node *expr, fuse_args *args, fuse_type type)
+{
+  int *done = (int *) calloc (args->num_temps, sizeof (int));
+  unsigned int w = fuseVectorWidth( type);
+  const char *base = (type == FUSE_DOUBLE ? "double" : "float");
+
+  if (type == FUSE_DOUBLE)
+    append( src, "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n");
+  append( src, "#define T %s\n#define W %u\n", base, w);
+  if (w > 1)
+    append( src, "#define TV %s%u\n#define VLOAD vload%u\n#define VSTORE vstore%u\n",
+            base, w, w, w);
+  else
+    append( src, "#define TV T\n#define VLOAD(i, p) (p)[i]\n#define VSTORE(v, i, p) (p)[i] = (v)\n");
+
+  append( src, "__kernel void fused(\n");
+  for (int k = 0; k < args->num_bufs; k++) {
+    append( src, "   __global const T* in%d,\n", k);
+    if (!args->dense)
+      append( src, "   const long rs%d, const long cs%d, const long off%d,\n", k, k, k);
+  }
+  for (int k = 0; k < args->num_scalars; k++)
+    append( src, "   const T s%d,\n", k);
+
+  if (!args->dense) {
+    /* views: a 2-D grid-stride loop addressing through the strides */
+    append( src, "   __global T* out,\n   const long ors, const long ocs, const long ooff,\n");
+    append( src, "   const ulong rows,\n   const ulong cols)\n{\n");
+    append( src, "   for( size_t r = get_global_id(1); r < rows; r += get_global_size(1))\n");
+    append( src, "   for( size_t c = get_global_id(0); c < cols; c += get_global_size(0)) {\n");
+    emitNode( src, expr, args, done, EMIT_STRIDED);
+    append( src, "     out[ooff + (long)r*ors + (long)c*ocs] = t%d;\n   }\n}\n", expr->id);
+    free( done);
+    return;
+  }
+
+  append( src, "   __global T* out,\n   const ulong n)\n{\n");
+  append( src, "   size_t stride = get_global_size(0);\n");
+  append( src, "   size_t nv = n / W;\n");
+
+  append( src, "   for( size_t i = get_global_id(0); i < nv; i += stride) {\n");
+  emitNode( src, expr, args, done, EMIT_VECTOR);
+  append( src, "     VSTORE( t%d, i, out);\n   }\n", expr->id);
+
+  if (w > 1) {
+    memset( done, 0, args->num_temps * sizeof (int));
+    append( src, "   for( size_t i = nv*W + get_global_id(0); i < n; i += stride) {\n");
+    emitNode( src, expr, args, done, EMIT_SCALAR);
+    append( src, "     out[i] = t%d;\n   }\n", expr->id);
+  }
+  append( src, "}\n");
+
+  free( done);
+}
+
+static unsigned long hashString( const char *s)
+{
+  unsigned long h = 5381;
+
+  while (*s)
+    h = h * 33 + (unsigned char) *s++;
+  return h;
+}
+
+static fuse_program *getProgram( char *source, cl_int *err)
+{
+  unsigned long hash = hashString( source);
+  fuse_program *p;
+
+  for (p = programs; p != NULL; p = p->next)
+    if (p->hash == hash && strcmp( p->source, source) == 0) {
+      *err = CL_SUCCESS;
+      return p;
+    }
+
+  p = (fuse_program *) calloc (1, sizeof (fuse_program));
+  p->hash = hash;
+  p->source = strdup( source);
+  p->program = clCreateProgramWithSource (context, 1, (const char **) &source, NULL, err);
+  if (*err != CL_SUCCESS) {
+    fprintf( stderr, "Error: Failed to create fused program (%d)!\n", *err);
+    p->program = NULL;
+  } else if ((*err = clBuildProgram (p->program, 1, &device, NULL, NULL, NULL)) != CL_SUCCESS) {
+    char buffer[2048];
+
+    clGetProgramBuildInfo (p->program, device, CL_PROGRAM_BUILD_LOG,
+                           sizeof (buffer), buffer, NULL);
+    fprintf( stderr, "Error: Failed to build fused kernel!\n%s\n%s\n", source, buffer);
+  } else {
+    p->kernel = clCreateKernel (p->program, "fused", err);
+    if (*err != CL_SUCCESS)
+      fprintf( stderr, "Error: Failed to create fused kernel (%d)!\n", *err);
+  }
+  /* only working programs are cached */
+  if (*err != CL_SUCCESS) {
+    if (p->program != NULL)
+      clReleaseProgram (p->program);
+    free( p->source);
+    free( p);
+    return NULL;
+  }
+  p->next = programs;
+  programs = p;
+  return p;
+}
+
+cl_int fuseEvalView( fuse_node *expr, cl_mem out, long row_stride, long col_stride, size_t offset)
+{
+  fuse_args args;
+  fuse_source src = { NULL, 0, 0 };
+  fuse_program *p;
+  int num_nodes = 0, arg = 0;
+  cl_ulong rows = expr->rows, cols = expr->cols, n = rows * cols;
+  size_t global[2], local[2] = { FUSE_LOCAL, 1 }, groups;
+  cl_int err;
+
+  /* nothing to write; a zero global size would fail the enqueue */
+  if (n == 0)
+    return CL_SUCCESS;
+
+  for (fuse_node *node = nodes; node != NULL; node = node->next) {
+    node->id = -1;
+    num_nodes++;
+  }
+  args.bufs = (fuse_node **) malloc (num_nodes * sizeof (fuse_node *));
+  args.scalars = (fuse_node **) malloc (num_nodes * sizeof (fuse_node *));
+  args.num_bufs = args.num_scalars = args.num_temps = 0;
+  args.dense = isDense( rows, cols, row_stride, col_stride, offset);
+
+  err = collect( expr, &args, expr->type, rows, cols);
+  if (err != CL_SUCCESS)
+    goto out;
+
+  generate( &src, expr, &args, expr->type);
+  p = getProgram( src.text, &err);
+  if (p == NULL)
+    goto out;
+
+  for (int k = 0; k < args.num_bufs; k++) {
+    fuse_node *view = args.bufs[k];
+
+    err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_mem), &view->buf);
+    if (!args.dense) {
+      /* broadcast dimensions do not advance */
+      cl_long rs = (view->rows == 1 ? 0 : view->rs);
+      cl_long cs = (view->cols == 1 ? 0 : view->cs);
+      cl_long off = view->offset;
+
+      err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_long), &rs);
+      err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_long), &cs);
+      err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_long), &off);
+    }
+  }
+  for (int k = 0; k < args.num_scalars; k++) {
+    if (expr->type == FUSE_DOUBLE) {
+      cl_double v = args.scalars[k]->val;
+      err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_double), &v);
+    } else {
+      cl_float v = args.scalars[k]->val;
+      err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_float), &v);
+    }
+  }
+  err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_mem), &out);
+  if (args.dense) {
+    err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_ulong), &n);
+  } else {
+    cl_long ors = row_stride, ocs = col_stride, ooff = offset;
+
+    err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_long), &ors);
+    err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_long), &ocs);
+    err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_long), &ooff);
+    err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_ulong), &rows);
+    err |= clSetKernelArg (p->kernel, arg++, sizeof (cl_ulong), &cols);
+  }
+  if (err != CL_SUCCESS)
+    goto out;
+
+  /* enough groups to fill the device, the kernel loops over the rest */
+  if (args.dense) {
+    groups = (n / fuseVectorWidth( expr->type) + local[0] - 1) / local[0];
+    if (groups > compute_units * FUSE_GROUPS_PER_UNIT)
+      groups = compute_units * FUSE_GROUPS_PER_UNIT;
+    if (groups == 0)
+      groups = 1;
+    global[0] = groups * local[0];
+    err = clEnqueueNDRangeKernel (queue, p->kernel, 1, NULL, global, local, 0, NULL, NULL);
+  } else {
+    groups = (cols + local[0] - 1) / local[0];
+    if (groups > FUSE_GROUPS_PER_UNIT)
+      groups = FUSE_GROUPS_PER_UNIT;
+    global[0] = groups * local[0];
+    global[1] = compute_units * FUSE_GROUPS_PER_UNIT * FUSE_GROUPS_PER_UNIT / groups;
+    if (global[1] > rows)
+      global[1] = rows;
+    err = clEnqueueNDRangeKernel (queue, p->kernel, 2, NULL, global, local, 0, NULL, NULL);
+  }
+
+out:
+  free( args.bufs);
+  free( args.scalars);
+  free( src.text);
+  return err;
+}
+
+cl_int fuseEval( fuse_node *expr, cl_mem out)
+{
+  return fuseEvalView( expr, out, expr->cols, 1, 0);
+}
+
+void fuseReset( void)
+{
+  while (nodes != NULL) {
+    fuse_node *node = nodes;
+
+    nodes = node->next;
+    free( node);
+  }
+}
+
+void fuseRelease( void)
+{
+  fuseReset();
+  while (programs != NULL) {
+    fuse_program *p = programs;
+
+    programs = p->next;
+    clReleaseKernel (p->kernel);
+    clReleaseProgram (p->program);
+    free( p->source);
+    free( p);
+  }
+}
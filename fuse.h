@@ -0,0 +1,96 @@
+#ifndef FUSE_H
+#define FUSE_H
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+/* Lazily recorded element-wise expressions over OpenCL buffers.
+ *
+ * The fuse* constructors only record a node; fuseEval() generates one
+ * OpenCL kernel for the whole expression, so every input element is read
+ * once and every output element written once, however many operations the
+ * expression has. The kernels use the device's preferred vector width and
+ * a grid-stride loop over a fixed number of work-groups. Programs are
+ * cached by their generated source, scalar operands are kernel arguments
+ * and do not cause rebuilds.
+ *
+ *   fuse_node *e = fuseSqr( fuseDiv( fuseAdd( fuseBuffer( a, n, FUSE_FLOAT),
+ *                                             fuseBuffer( b, n, FUSE_FLOAT)),
+ *                                    fuseBuffer( c, n, FUSE_FLOAT)));
+ *   err = fuseEval( e, out);
+ *   fuseReset();
+ */
+
+typedef enum { FUSE_FLOAT, FUSE_DOUBLE } fuse_type;
+
+typedef enum {
+  FUSE_BUFFER, FUSE_SCALAR,
+  FUSE_ADD, FUSE_SUB, FUSE_MUL, FUSE_DIV, FUSE_MIN, FUSE_MAX,
+  FUSE_NEG, FUSE_SQR, FUSE_SQRT, FUSE_EXP, FUSE_LOG, FUSE_ABS
+} fuse_op;
+
+typedef struct fuse_node {
+  fuse_op op;
+  fuse_type type;
+  struct fuse_node *a, *b;
+  cl_mem buf;                   /* FUSE_BUFFER view: */
+  long rs, cs;                  /*   row and column stride in elements */
+  size_t offset;                /*   first element */
+  double val;                   /* FUSE_SCALAR */
+  size_t rows, cols;            /* shape, 1 x 1 for scalars */
+  int id;                       /* used during code generation */
+  struct fuse_node *next;       /* all recorded nodes */
+} fuse_node;
+
+/* Also picks the vector width of the generated kernels from
+ * CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT/DOUBLE. */
+void fuseSetDevice( cl_context context, cl_device_id device, cl_command_queue queue);
+
+unsigned int fuseVectorWidth( fuse_type type);
+
+/* a dense vector of n elements, i.e. a 1 x n view */
+fuse_node *fuseBuffer( cl_mem buf, size_t n, fuse_type type);
+
+/* A rows x cols view of buf starting at element offset: element (r,c) is
+ * buf[offset + r*row_stride + c*col_stride]. Sub-matrices, transposed or
+ * reversed matrices are views without copies. Operands broadcast as in
+ * numpy: a 1 x cols row or a rows x 1 column is repeated to the shape of
+ * the other operand.  */
+fuse_node *fuseView( cl_mem buf, size_t rows, size_t cols,
+                     long row_stride, long col_stride, size_t offset, fuse_type type);
+
+fuse_node *fuseScalar( double val);
+
+fuse_node *fuseAdd( fuse_node *a, fuse_node *b);
+fuse_node *fuseSub( fuse_node *a, fuse_node *b);
+fuse_node *fuseMul( fuse_node *a, fuse_node *b);
+fuse_node *fuseDiv( fuse_node *a, fuse_node *b);
+fuse_node *fuseMin( fuse_node *a, fuse_node *b);
+fuse_node *fuseMax( fuse_node *a, fuse_node *b);
+
+fuse_node *fuseNeg( fuse_node *a);
+fuse_node *fuseSqr( fuse_node *a);
+fuse_node *fuseSqrt( fuse_node *a);
+fuse_node *fuseExp( fuse_node *a);
+fuse_node *fuseLog( fuse_node *a);
+fuse_node *fuseAbs( fuse_node *a);
+
+/* Evaluates expr into the dense buffer out (which may also be one of its
+ * inputs). Returns CL_INVALID_BUFFER_SIZE if the operands' shapes do not
+ * broadcast. Only if all operands and the result are dense, the vectorised
+ * kernel is used; otherwise every element is addressed through strides.  */
+cl_int fuseEval( fuse_node *expr, cl_mem out);
+
+/* same, writing into a view of out with the shape of expr */
+cl_int fuseEvalView( fuse_node *expr, cl_mem out, long row_stride, long col_stride, size_t offset);
+
+/* frees all recorded nodes; cached programs stay */
+void fuseReset( void);
+
+/* frees nodes and cached programs */
+void fuseRelease( void);
+
+#endif
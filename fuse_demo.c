@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "timer.h"
+#include "fuse.h"
+
+/* Computes ((a+b)/c)^2 with one kernel per operation (two temporaries)
+ * and as one fused kernel, then checks strided views and broadcasting
+ * against the host (checkViews).
+ *
+ * usage: fuse_demo [count [cpu]]
+ */
+
+#define DATA_SIZE 10240000
+
+#define die(msg, ...) do {                      \
+  (void) fprintf (stderr, msg, ## __VA_ARGS__); \
+  (void) fprintf (stderr, "\n");                \
+} while (0)
+
+int startsec, startnsec, stopsec, stopnsec;
+
+void printTimeElapsed( char *text)
+{
+  double elapsed = (stopsec -startsec)*1000.0
+                  + (double)(stopnsec -startnsec)/1000000.0;
+  printf( "%s: %f msec\n", text, elapsed);
+}
+
+/* Through views of a rows x cols matrix m, a 1 x cols row r and a
+ * rows x 1 column c, all dense on the device:
+ *   t = 2 * transpose(m)        a cols x rows view with swapped strides
+ *   b = m - r + c               both vectors broadcast to rows x cols
+ *   s = sub-matrix of m + 1     written into the middle of b
+ * Returns the number of wrong elements.  */
+size_t checkViews( cl_context context, cl_command_queue commands, size_t rows, size_t cols)
+{
+  size_t n = rows * cols, wrong = 0;
+  size_t sr = rows / 2, sc = cols / 2, so = (rows / 4) * cols + cols / 4;
+  float *m = (float *) malloc (n * sizeof (float));
+  float *r = (float *) malloc (cols * sizeof (float));
+  float *c = (float *) malloc (rows * sizeof (float));
+  float *t = (float *) malloc (n * sizeof (float));
+  float *b = (float *) malloc (n * sizeof (float));
+  cl_mem d_m, d_r, d_c, d_t, d_b;
+  cl_int err;
+
+  for (size_t i = 0; i < n; i++)
+    m[i] = (float) (i % 1000);
+  for (size_t j = 0; j < cols; j++)
+    r[j] = (float) j;
+  for (size_t i = 0; i < rows; i++)
+    c[i] = (float) (3 * i);
+
+  d_m = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, n * sizeof (float), m, &err);
+  d_r = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, cols * sizeof (float), r, &err);
+  d_c = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, rows * sizeof (float), c, &err);
+  d_t = clCreateBuffer (context, CL_MEM_WRITE_ONLY, n * sizeof (float), NULL, &err);
+  d_b = clCreateBuffer (context, CL_MEM_READ_WRITE, n * sizeof (float), NULL, &err);
+
+  err = fuseEval( fuseMul( fuseScalar( 2.0),
+                           fuseView( d_m, cols, rows, 1, cols, 0, FUSE_FLOAT)), d_t);
+  err |= fuseEval( fuseAdd( fuseSub( fuseView( d_m, rows, cols, cols, 1, 0, FUSE_FLOAT),
+                                     fuseView( d_r, 1, cols, 0, 1, 0, FUSE_FLOAT)),
+                            fuseView( d_c, rows, 1, 1, 0, 0, FUSE_FLOAT)), d_b);
+  err |= fuseEvalView( fuseAdd( fuseView( d_m, sr, sc, cols, 1, so, FUSE_FLOAT),
+                                fuseScalar( 1.0)), d_b, cols, 1, so);
+  err |= clEnqueueReadBuffer (commands, d_t, CL_TRUE, 0, n * sizeof (float), t, 0, NULL, NULL);
+  err |= clEnqueueReadBuffer (commands, d_b, CL_TRUE, 0, n * sizeof (float), b, 0, NULL, NULL);
+  fuseReset();
+
+  if (err != CL_SUCCESS) {
+    die( "Error: view evaluation failed!");
+    wrong = n;
+  } else {
+    /* all values are small integers, exact in float */
+    for (size_t i = 0; i < rows; i++)
+      for (size_t j = 0; j < cols; j++) {
+        size_t q = i * cols + j;
+        int inside = (q >= so && (q - so) / cols < sr && (q - so) % cols < sc);
+        float expected = (inside ? m[q] + 1.0f : m[q] - r[j] + c[i]);
+
+        wrong += (t[j * rows + i] != 2.0f * m[q]);
+        wrong += (b[q] != expected);
+      }
+  }
+
+  clReleaseMemObject (d_m);
+  clReleaseMemObject (d_r);
+  clReleaseMemObject (d_c);
+  clReleaseMemObject (d_t);
+  clReleaseMemObject (d_b);
+  free( m);
+  free( r);
+  free( c);
+  free( t);
+  free( b);
+  return wrong;
+}
+
+int main (int argc, char * argv[])
+{
+  size_t count = (argc > 1 ? atol( argv[1]) : DATA_SIZE);
+  int devType = (argc > 2 ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU);
+  size_t bytes = count * sizeof (float);
+  cl_platform_id platform;
+  cl_device_id device_id;
+  cl_context context;
+  cl_command_queue commands;
+  cl_mem d_a, d_b, d_c, d_t1, d_t2, d_out;
+  cl_int err;
+  size_t correct;
+
+  float *a = (float *) malloc (bytes);
+  float *b = (float *) malloc (bytes);
+  float *c = (float *) malloc (bytes);
+  float *expected = (float *) malloc (bytes);
+  float *results = (float *) malloc (bytes);
+
+  for (size_t i = 0; i < count; i++) {
+    a[i] = rand () / (float) RAND_MAX;
+    b[i] = rand () / (float) RAND_MAX;
+    c[i] = 1.0f + rand () / (float) RAND_MAX;
+  }
+
+  TIMERwc_time( &startsec, &startnsec);
+  for (size_t i = 0; i < count; i++) {
+    float t = (a[i] + b[i]) / c[i];
+    expected[i] = t * t;
+  }
+  TIMERwc_time( &stopsec, &stopnsec);
+  printTimeElapsed( "kernel equivalent on host");
+
+  err = clGetPlatformIDs (1, &platform, NULL);
+  err |= clGetDeviceIDs (platform, devType, 1, &device_id, NULL);
+  if (err != CL_SUCCESS) {
+    die( "Error: Failed to find a device!");
+    return 1;
+  }
+  context = clCreateContext (0, 1, &device_id, NULL, NULL, &err);
+  commands = clCreateCommandQueue (context, device_id, 0, &err);
+  d_a = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, a, &err);
+  d_b = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, b, &err);
+  d_c = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, c, &err);
+  d_t1 = clCreateBuffer (context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+  d_t2 = clCreateBuffer (context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+  d_out = clCreateBuffer (context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
+  fuseSetDevice( context, device_id, commands);
+  printf( "vector width: %u\n", fuseVectorWidth( FUSE_FLOAT));
+
+  /* run each variant twice, the first run includes building the program */
+  for (int run = 0; run < 2; run++) {
+    TIMERwc_time( &startsec, &startnsec);
+    err = fuseEval( fuseAdd( fuseBuffer( d_a, count, FUSE_FLOAT),
+                             fuseBuffer( d_b, count, FUSE_FLOAT)), d_t1);
+    err |= fuseEval( fuseDiv( fuseBuffer( d_t1, count, FUSE_FLOAT),
+                              fuseBuffer( d_c, count, FUSE_FLOAT)), d_t2);
+    err |= fuseEval( fuseSqr( fuseBuffer( d_t2, count, FUSE_FLOAT)), d_out);
+    clFinish (commands);
+    TIMERwc_time( &stopsec, &stopnsec);
+    fuseReset();
+    if (err != CL_SUCCESS)
+      die( "Error: unfused evaluation failed!");
+    printTimeElapsed( "three kernels, two temporaries");
+  }
+
+  for (int run = 0; run < 2; run++) {
+    TIMERwc_time( &startsec, &startnsec);
+    err = fuseEval( fuseSqr( fuseDiv( fuseAdd( fuseBuffer( d_a, count, FUSE_FLOAT),
+                                               fuseBuffer( d_b, count, FUSE_FLOAT)),
+                                      fuseBuffer( d_c, count, FUSE_FLOAT))), d_out);
+    clFinish (commands);
+    TIMERwc_time( &stopsec, &stopnsec);
+    fuseReset();
+    if (err != CL_SUCCESS)
+      die( "Error: fused evaluation failed!");
+    printTimeElapsed( "one fused kernel");
+  }
+
+  err = clEnqueueReadBuffer (commands, d_out, CL_TRUE, 0, bytes, results, 0, NULL, NULL);
+
+  /* the device may contract to fma, so allow for the last bit */
+  correct = 0;
+  for (size_t i = 0; i < count; i++)
+    if (fabsf( results[i] - expected[i]) <= 1e-6f * expected[i])
+      correct++;
+  printf ("Computed %lu/%lu correct values\n", (unsigned long)correct, (unsigned long)count);
+
+  /* odd shapes so that no row is a multiple of the vector width */
+  printf ("Views: %lu wrong values\n", (unsigned long)checkViews( context, commands, 301, 203));
+
+  fuseRelease();
+  clReleaseMemObject (d_a);
+  clReleaseMemObject (d_b);
+  clReleaseMemObject (d_c);
+  clReleaseMemObject (d_t1);
+  clReleaseMemObject (d_t2);
+  clReleaseMemObject (d_out);
+  clReleaseCommandQueue (commands);
+  clReleaseContext (context);
+  free( a);
+  free( b);
+  free( c);
+  free( expected);
+  free( results);
+
+  return 0;
+}
@@ -0,0 +1,496 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "integrate.h"
+
+#define INTEGRATE_LOCAL 64
+#define INTEGRATE_GROUPS_PER_UNIT 8
+/* intervals per pass of the adaptive rule, and passes before the
+ * remaining intervals are accepted as they are */
+#define INTEGRATE_MAX_INTERVALS (1 << 20)
+#define INTEGRATE_MAX_PASSES 64
+
+typedef struct integrate_program {
+  char *source;
+  cl_program program;
+  cl_kernel kernel;
+  struct integrate_program *next;
+} integrate_program;
+
+static integrate_program *programs = NULL;
+
+static cl_context context = NULL;
+static cl_device_id device = NULL;
+static cl_command_queue queue = NULL;
+static cl_uint compute_units = 1;
+
+/* interval lists of the adaptive rule, current and next pass */
+static cl_mem intervals[2] = { NULL, NULL };
+static cl_mem interval_count = NULL;
+
+/* 15-point Kronrod nodes (the odd ones are the 7-point Gauss nodes) and
+ * weights, from QUADPACK's qk15 */
+static const double xgk[8] = {
+  0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+  0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+  0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+  0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+static const double wgk[8] = {
+  0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+  0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+  0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+  0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+static const double wg[4] = {
+  0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+  0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+/* F(x), RULE and the node tables are defined in front of this */
+const char *IntegrateKernelSource =                                      "\n"
+  "void groupSum2( double *a, double *b, __local double* scratch)         \n"
+  "{                                                                      \n"
+  "   uint lid = get_local_id(0);                                         \n"
+  "   uint ls = get_local_size(0);                                        \n"
+  "   uint n = ls;                                                        \n"
+  "   scratch[lid] = *a;                                                  \n"
+  "   scratch[ls+lid] = *b;                                               \n"
+  "   barrier( CLK_LOCAL_MEM_FENCE);                                      \n"
+  "     while( n > 1) {                                                   \n"
+  "       uint h = (n+1)/2;                                               \n"
+  "       if( lid < n-h) {                                                \n"
+  "         scratch[lid] += scratch[lid+h];                               \n"
+  "         scratch[ls+lid] += scratch[ls+lid+h];                         \n"
+  "       }                                                               \n"
+  "       barrier( CLK_LOCAL_MEM_FENCE);                                  \n"
+  "       n = h;                                                          \n"
+  "     }                                                                 \n"
+  "   *a = scratch[0];                                                    \n"
+  "   *b = scratch[ls];                                                   \n"
+  "}                                                                      \n"
+  "                                                                       \n"
+  "#if RULE != 2                                                          \n"
+  "/* weighted sum of f over the rule's points; the host scales it */     \n"
+  "__kernel void quadrature(                                              \n"
+  "   const double a,                                                     \n"
+  "   const double h,                                                     \n"
+  "   const ulong n,                                                      \n"
+  "   __global double* partials,                                          \n"
+  "   __local double* scratch)                                            \n"
+  "{                                                                      \n"
+  "   double sum = 0.0, unused = 0.0;                                     \n"
+  "#if RULE == 0                                                          \n"
+  "     for( ulong k = get_global_id(0); k < n; k += get_global_size(0))  \n"
+  "       sum += F( a + (k + 0.5) * h);                                   \n"
+  "#else                                                                  \n"
+  "     for( ulong k = get_global_id(0); k <= 2*n; k += get_global_size(0)) {\n"
+  "       double w = (k == 0 || k == 2*n) ? 1.0 : (k & 1) ? 4.0 : 2.0;    \n"
+  "       sum += w * F( a + k * (0.5 * h));                               \n"
+  "     }                                                                 \n"
+  "#endif                                                                 \n"
+  "   groupSum2( &sum, &unused, scratch);                                 \n"
+  "   if( get_local_id(0) == 0)                                           \n"
+  "     partials[get_group_id(0)] = sum;                                  \n"
+  "}                                                                      \n"
+  "#else                                                                  \n"
+  "void gk15( double lo, double hi, double *val, double *err)             \n"
+  "{                                                                      \n"
+  "   double c = 0.5 * (lo + hi), hl = 0.5 * (hi - lo);                   \n"
+  "   double fc = F( c);                                                  \n"
+  "   double resk = fc * wgk[7], resg = fc * wg[3];                       \n"
+  "     for( int j=0; j<7; j++) {                                         \n"
+  "       double dx = hl * xgk[j];                                        \n"
+  "       double fs = F( c - dx) + F( c + dx);                            \n"
+  "       resk += wgk[j] * fs;                                            \n"
+  "       if( j & 1)                                                      \n"
+  "         resg += wg[j/2] * fs;                                         \n"
+  "     }                                                                 \n"
+  "   *val = resk * hl;                                                   \n"
+  "   *err = fabs( (resk - resg) * hl);                                   \n"
+  "}                                                                      \n"
+  "                                                                       \n"
+  "/* one pass: evaluate every interval, accept it or append its halves  \n"
+  " * to next; per group sums of the accepted values and errors */       \n"
+  "__kernel void quadrature(                                              \n"
+  "   __global const double2* iv,                                         \n"
+  "   const uint n,                                                       \n"
+  "   const double tol_density,                                           \n"
+  "   const double min_width,                                             \n"
+  "   __global double2* next,                                             \n"
+  "   __global volatile uint* count,                                      \n"
+  "   const uint capacity,                                                \n"
+  "   __global double* partials,                                          \n"
+  "   __local double* scratch)                                            \n"
+  "{                                                                      \n"
+  "   double accepted = 0.0, errsum = 0.0;                                \n"
+  "     for( uint i = get_global_id(0); i < n; i += get_global_size(0)) { \n"
+  "       double lo = iv[i].x, hi = iv[i].y, val, err;                    \n"
+  "       gk15( lo, hi, &val, &err);                                      \n"
+  "       double width = fabs( hi - lo);                                  \n"
+  "       int split = err > tol_density * width && width > min_width;     \n"
+  "       if( split) {                                                    \n"
+  "         uint slot = atomic_add( count, 2);                            \n"
+  "         if( slot + 2 <= capacity) {                                   \n"
+  "           double mid = 0.5 * (lo + hi);                               \n"
+  "           next[slot] = (double2)( lo, mid);                           \n"
+  "           next[slot+1] = (double2)( mid, hi);                         \n"
+  "         } else {                                                      \n"
+  "           split = 0;                                                  \n"
+  "         }                                                             \n"
+  "       }                                                               \n"
+  "       if( !split) {                                                   \n"
+  "         accepted += val;                                              \n"
+  "         errsum += err;                                                \n"
+  "       }                                                               \n"
+  "     }                                                                 \n"
+  "   groupSum2( &accepted, &errsum, scratch);                            \n"
+  "   if( get_local_id(0) == 0) {                                         \n"
+  "     partials[2*get_group_id(0)] = accepted;                           \n"
+  "     partials[2*get_group_id(0)+1] = errsum;                           \n"
+  "   }                                                                   \n"
+  "}                                                                      \n"
+  "#endif                                                                 \n"
+  "\n";
+
+void integrateSetDevice( cl_context ctx, cl_device_id dev, cl_command_queue q)
+{
+  if (ctx != context || dev != device)
+    integrateRelease();
+  context = ctx;
+  device = dev;
+  queue = q;
+
+  compute_units = 1;
+  clGetDeviceInfo (dev, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof (cl_uint), &compute_units, NULL);
+  if (compute_units == 0)
+    compute_units = 1;
+}
+
+static void appendTable( char **pos, const char *name, const double *v, int n)
+{
+  *pos += sprintf( *pos, "__constant double %s[%d] = {", name, n);
+  for (int k = 0; k < n; k++)
+    *pos += sprintf( *pos, "%s%.21e", k ? ", " : " ", v[k]);
+  *pos += sprintf( *pos, " };\n");
+}
+
+static integrate_program *getProgram( const char *expr, integrate_rule rule, cl_int *err)
+{
+  size_t len = strlen( IntegrateKernelSource) + strlen( expr) + 4096;
+  char *source = (char *) malloc (len);
+  char *pos = source;
+  integrate_program *p;
+
+  pos += sprintf( pos, "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n");
+  pos += sprintf( pos, "#define RULE %d\n#define F(x) (%s)\n", (int) rule, expr);
+  if (rule == INTEGRATE_GAUSS_KRONROD) {
+    appendTable( &pos, "xgk", xgk, 8);
+    appendTable( &pos, "wgk", wgk, 8);
+    appendTable( &pos, "wg", wg, 4);
+  }
+  strcpy( pos, IntegrateKernelSource);
+
+  for (p = programs; p != NULL; p = p->next)
+    if (strcmp( p->source, source) == 0) {
+      free( source);
+      *err = CL_SUCCESS;
+      return p;
+    }
+
+  p = (integrate_program *) calloc (1, sizeof (integrate_program));
+  p->source = source;
+  p->program = clCreateProgramWithSource (context, 1, (const char **) &source, NULL, err);
+  if (*err != CL_SUCCESS) {
+    fprintf( stderr, "Error: Failed to create program for integrand %s (%d)!\n", expr, *err);
+    p->program = NULL;
+  } else if ((*err = clBuildProgram (p->program, 1, &device, NULL, NULL, NULL)) != CL_SUCCESS) {
+    char buffer[2048];
+
+    clGetProgramBuildInfo (p->program, device, CL_PROGRAM_BUILD_LOG,
+                           sizeof (buffer), buffer, NULL);
+    fprintf( stderr, "Error: Failed to build integrand %s!\n%s\n", expr, buffer);
+  } else {
+    p->kernel = clCreateKernel (p->program, "quadrature", err);
+    if (*err != CL_SUCCESS)
+      fprintf( stderr, "Error: Failed to create kernel for integrand %s (%d)!\n", expr, *err);
+  }
+  /* only working programs are cached */
+  if (*err != CL_SUCCESS) {
+    if (p->program != NULL)
+      clReleaseProgram (p->program);
+    free( p->source);
+    free( p);
+    return NULL;
+  }
+  p->next = programs;
+  programs = p;
+  return p;
+}
+
+static cl_int fixedRule( integrate_program *p, integrate_rule rule, double a, double b,
+                         long long n, double *result)
+{
+  size_t local = INTEGRATE_LOCAL;
+  size_t groups = compute_units * INTEGRATE_GROUPS_PER_UNIT;
+  size_t global = groups * local;
+  double h = (b - a) / n;
+  cl_ulong panels = n;
+  double *partials = (double *) malloc (groups * sizeof (double));
+  double sum = 0.0;
+  cl_mem d_partials;
+  cl_int err;
+
+  d_partials = clCreateBuffer (context, CL_MEM_WRITE_ONLY, groups * sizeof (double), NULL, &err);
+  if (err != CL_SUCCESS) {
+    free( partials);
+    return err;
+  }
+  err = clSetKernelArg (p->kernel, 0, sizeof (cl_double), &a);
+  err |= clSetKernelArg (p->kernel, 1, sizeof (cl_double), &h);
+  err |= clSetKernelArg (p->kernel, 2, sizeof (cl_ulong), &panels);
+  err |= clSetKernelArg (p->kernel, 3, sizeof (cl_mem), &d_partials);
+  err |= clSetKernelArg (p->kernel, 4, 2 * local * sizeof (cl_double), NULL);
+  if (err == CL_SUCCESS)
+    err = clEnqueueNDRangeKernel (queue, p->kernel, 1, NULL, &global, &local, 0, NULL, NULL);
+  if (err == CL_SUCCESS)
+    err = clEnqueueReadBuffer (queue, d_partials, CL_TRUE, 0, groups * sizeof (double), partials, 0, NULL, NULL);
+  for (size_t g = 0; g < groups; g++)
+    sum += partials[g];
+  *result = (rule == INTEGRATE_MIDPOINT ? sum * h : sum * h / 6.0);
+
+  clReleaseMemObject (d_partials);
+  free( partials);
+  return err;
+}
+
+static cl_int adaptiveRule( integrate_program *p, double a, double b, long long n, double tol,
+                            double *result, double *error)
+{
+  size_t local = INTEGRATE_LOCAL;
+  size_t groups = compute_units * INTEGRATE_GROUPS_PER_UNIT;
+  size_t global;
+  cl_uint capacity = INTEGRATE_MAX_INTERVALS;
+  cl_uint count, zero = 0;
+  double min_width = fabs( b - a) * 1e-13;
+  double *partials = (double *) malloc (2 * groups * sizeof (double));
+  double sum = 0.0, errsum = 0.0;
+  cl_mem d_partials;
+  int cur = 0;
+  cl_int err = CL_SUCCESS;
+
+  if (n > INTEGRATE_MAX_INTERVALS)
+    n = INTEGRATE_MAX_INTERVALS;
+  for (int k = 0; k < 2 && err == CL_SUCCESS; k++)
+    if (intervals[k] == NULL)
+      intervals[k] = clCreateBuffer (context, CL_MEM_READ_WRITE,
+                                     INTEGRATE_MAX_INTERVALS * 2 * sizeof (cl_double), NULL, &err);
+  if (err == CL_SUCCESS && interval_count == NULL)
+    interval_count = clCreateBuffer (context, CL_MEM_READ_WRITE, sizeof (cl_uint), NULL, &err);
+  d_partials = clCreateBuffer (context, CL_MEM_WRITE_ONLY, 2 * groups * sizeof (double), NULL, &err);
+  if (err != CL_SUCCESS) {
+    free( partials);
+    return err;
+  }
+
+  /* the initial equal intervals */
+  {
+    double *iv = (double *) malloc (2 * n * sizeof (double));
+
+    for (long long i = 0; i < n; i++) {
+      iv[2*i] = a + (b - a) * i / n;
+      iv[2*i+1] = (i + 1 == n ? b : a + (b - a) * (i + 1) / n);
+    }
+    err = clEnqueueWriteBuffer (queue, intervals[0], CL_TRUE, 0, 2 * n * sizeof (double), iv, 0, NULL, NULL);
+    free( iv);
+  }
+  count = n;
+
+  for (int pass = 0; count > 0 && err == CL_SUCCESS; pass++) {
+    /* after the last pass every remaining interval is accepted */
+    double tol_density = (pass + 1 == INTEGRATE_MAX_PASSES ? INFINITY : tol / fabs( b - a));
+    cl_uint n_pass = count;
+
+    err = clEnqueueWriteBuffer (queue, interval_count, CL_FALSE, 0, sizeof (cl_uint), &zero, 0, NULL, NULL);
+    err |= clSetKernelArg (p->kernel, 0, sizeof (cl_mem), &intervals[cur]);
+    err |= clSetKernelArg (p->kernel, 1, sizeof (cl_uint), &n_pass);
+    err |= clSetKernelArg (p->kernel, 2, sizeof (cl_double), &tol_density);
+    err |= clSetKernelArg (p->kernel, 3, sizeof (cl_double), &min_width);
+    err |= clSetKernelArg (p->kernel, 4, sizeof (cl_mem), &intervals[1-cur]);
+    err |= clSetKernelArg (p->kernel, 5, sizeof (cl_mem), &interval_count);
+    err |= clSetKernelArg (p->kernel, 6, sizeof (cl_uint), &capacity);
+    err |= clSetKernelArg (p->kernel, 7, sizeof (cl_mem), &d_partials);
+    err |= clSetKernelArg (p->kernel, 8, 2 * local * sizeof (cl_double), NULL);
+    if (err != CL_SUCCESS)
+      break;
+    global = (n_pass + local - 1) / local;
+    if (global > groups)
+      global = groups;
+    global *= local;
+    err = clEnqueueNDRangeKernel (queue, p->kernel, 1, NULL, &global, &local, 0, NULL, NULL);
+    if (err == CL_SUCCESS)
+      err = clEnqueueReadBuffer (queue, d_partials, CL_FALSE, 0, 2 * global / local * sizeof (double),
+                                 partials, 0, NULL, NULL);
+    if (err == CL_SUCCESS)
+      err = clEnqueueReadBuffer (queue, interval_count, CL_TRUE, 0, sizeof (cl_uint), &count, 0, NULL, NULL);
+    for (size_t g = 0; g < global / local; g++) {
+      sum += partials[2*g];
+      errsum += partials[2*g+1];
+    }
+    /* slots past the capacity were claimed but not written */
+    if (count > capacity)
+      count = capacity;
+    cur = 1 - cur;
+  }
+
+  *result = sum;
+  if (error != NULL)
+    *error = errsum;
+  clReleaseMemObject (d_partials);
+  free( partials);
+  return err;
+}
+
+cl_int integrate( const char *expr, integrate_rule rule, double a, double b,
+                  long long n, double tol, double *result, double *error)
+{
+  integrate_program *p;
+  cl_int err;
+
+  if (n < 1 || (rule == INTEGRATE_GAUSS_KRONROD && !(tol > 0.0)))
+    return CL_INVALID_VALUE;
+  p = getProgram( expr, rule, &err);
+  if (p == NULL)
+    return err;
+  if (rule != INTEGRATE_GAUSS_KRONROD) {
+    if (error != NULL)
+      *error = 0.0;
+    return fixedRule( p, rule, a, b, n, result);
+  }
+  return adaptiveRule( p, a, b, n, tol, result, error);
+}
+
+static void gk15Host( double (*f)( double), double lo, double hi, double *val, double *err)
+{
+  double c = 0.5 * (lo + hi), hl = 0.5 * (hi - lo);
+  double fc = f( c);
+  double resk = fc * wgk[7], resg = fc * wg[3];
+
+  for (int j = 0; j < 7; j++) {
+    double dx = hl * xgk[j];
+    double fs = f( c - dx) + f( c + dx);
+    resk += wgk[j] * fs;
+    if (j & 1)
+      resg += wg[j/2] * fs;
+  }
+  *val = resk * hl;
+  *err = fabs( (resk - resg) * hl);
+}
+
+int integrateHost( double (*f)( double), integrate_rule rule, double a, double b,
+                   long long n, double tol, double *result, double *error)
+{
+  double h = (b - a) / n;
+  double sum = 0.0, errsum = 0.0;
+
+  if (n < 1 || (rule == INTEGRATE_GAUSS_KRONROD && !(tol > 0.0)))
+    return -1;
+
+  if (rule == INTEGRATE_MIDPOINT) {
+#pragma omp parallel for schedule(static) reduction(+:sum)
+    for (long long k = 0; k < n; k++)
+      sum += f( a + (k + 0.5) * h);
+    sum *= h;
+  } else if (rule == INTEGRATE_SIMPSON) {
+#pragma omp parallel for schedule(static) reduction(+:sum)
+    for (long long k = 0; k <= 2*n; k++)
+      sum += (k == 0 || k == 2*n ? 1.0 : (k & 1) ? 4.0 : 2.0) * f( a + k * (0.5 * h));
+    sum *= h / 6.0;
+  } else {
+    /* same passes as on the device: evaluate all intervals in parallel,
+     * then bisect the rejected ones into the next list */
+    double min_width = fabs( b - a) * 1e-13;
+    long long count = n, capacity = 2 * n;
+    double *iv = (double *) malloc (2 * capacity * sizeof (double));
+    double *next_iv = (double *) malloc (2 * capacity * sizeof (double));
+    double *val = (double *) malloc (capacity * sizeof (double));
+    double *err = (double *) malloc (capacity * sizeof (double));
+
+    for (long long i = 0; i < n; i++) {
+      iv[2*i] = a + (b - a) * i / n;
+      iv[2*i+1] = (i + 1 == n ? b : a + (b - a) * (i + 1) / n);
+    }
+    for (int pass = 0; count > 0; pass++) {
+      double tol_density = (pass + 1 == INTEGRATE_MAX_PASSES ? INFINITY : tol / fabs( b - a));
+      long long next = 0;
+      double *tmp;
+
+      /* both lists hold capacity intervals, enough for all halves */
+      if (2 * count > capacity) {
+        capacity = 2 * count;
+        iv = (double *) realloc (iv, 2 * capacity * sizeof (double));
+        next_iv = (double *) realloc (next_iv, 2 * capacity * sizeof (double));
+        val = (double *) realloc (val, capacity * sizeof (double));
+        err = (double *) realloc (err, capacity * sizeof (double));
+      }
+
+#pragma omp parallel for schedule(dynamic, 16)
+      for (long long i = 0; i < count; i++)
+        gk15Host( f, iv[2*i], iv[2*i+1], &val[i], &err[i]);
+
+      for (long long i = 0; i < count; i++) {
+        /* intervals run backwards when b < a, so compare against |hi - lo| */
+        double lo = iv[2*i], hi = iv[2*i+1], width = fabs( hi - lo);
+
+        if (err[i] > tol_density * width && width > min_width
+            && next + 2 <= INTEGRATE_MAX_INTERVALS) {
+          double mid = 0.5 * (lo + hi);
+          next_iv[2*next] = lo;
+          next_iv[2*next+1] = mid;
+          next_iv[2*next+2] = mid;
+          next_iv[2*next+3] = hi;
+          next += 2;
+        } else {
+          sum += val[i];
+          errsum += err[i];
+        }
+      }
+      tmp = iv;
+      iv = next_iv;
+      next_iv = tmp;
+      count = next;
+    }
+    free( iv);
+    free( next_iv);
+    free( val);
+    free( err);
+  }
+
+  *result = sum;
+  if (error != NULL)
+    *error = errsum;
+  return 0;
+}
+
+void integrateRelease( void)
+{
+  while (programs != NULL) {
+    integrate_program *p = programs;
+
+    programs = p->next;
+    clReleaseKernel (p->kernel);
+    clReleaseProgram (p->program);
+    free( p->source);
+    free( p);
+  }
+  for (int k = 0; k < 2; k++) {
+    if (intervals[k] != NULL)
+      clReleaseMemObject (intervals[k]);
+    intervals[k] = NULL;
+  }
+  if (interval_count != NULL)
+    clReleaseMemObject (interval_count);
+  interval_count = NULL;
+}
@@ -0,0 +1,51 @@
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+/* Numerical integration of f over [a,b] in double precision.
+ *
+ * On the device the integrand is an OpenCL C expression of x, compiled
+ * into the quadrature kernels (programs are cached per integrand and
+ * rule); on the host it is a C function and the work is split over the
+ * OpenMP threads.
+ *
+ * The fixed rules use n panels: the midpoint rule evaluates f at the
+ * panel centres, composite Simpson at the 2n+1 panel ends and centres.
+ * The adaptive rule applies 15-point Gauss-Kronrod to n initial
+ * intervals and bisects every interval whose error estimate |K15 - G7|
+ * exceeds its share tol * width/(b-a) of the tolerance. On the device
+ * all intervals of a pass are evaluated and refined in one kernel, the
+ * bisected halves are appended to the next pass's list there, and only
+ * per-group sums of the accepted values and errors come back.
+ *
+ *   double pi, err;
+ *   cl_int status = integrate( "4.0/(1.0+x*x)", INTEGRATE_GAUSS_KRONROD,
+ *                              0.0, 1.0, 64, 1e-12, &pi, &err);
+ */
+
+typedef enum {
+  INTEGRATE_MIDPOINT, INTEGRATE_SIMPSON, INTEGRATE_GAUSS_KRONROD
+} integrate_rule;
+
+/* the device must support cl_khr_fp64 */
+void integrateSetDevice( cl_context context, cl_device_id device, cl_command_queue queue);
+
+/* error receives the estimated absolute error for
+ * INTEGRATE_GAUSS_KRONROD, 0 for the fixed rules; it may be NULL. Returns
+ * CL_INVALID_VALUE for n < 1 or tol <= 0 with the adaptive rule.  */
+cl_int integrate( const char *expr, integrate_rule rule, double a, double b,
+                  long long n, double tol, double *result, double *error);
+
+/* as integrate, returns 0 or -1 for invalid arguments */
+int integrateHost( double (*f)( double), integrate_rule rule, double a, double b,
+                   long long n, double tol, double *result, double *error);
+
+/* releases cached programs and interval buffers */
+void integrateRelease( void);
+
+#endif
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "timer.h"
+#include "integrate.h"
+
+/* Integrates a few test functions with every rule, on the host with
+ * integrateHost() and on the device with integrate(), and compares the
+ * results with the exact values.
+ *
+ * usage: integrate_demo [n [tol [cpu]]]
+ */
+
+#define die(msg, ...) do {                      \
+  (void) fprintf (stderr, msg, ## __VA_ARGS__); \
+  (void) fprintf (stderr, "\n");                \
+} while (0)
+
+int startsec, startnsec, stopsec, stopnsec;
+
+double elapsedMsec( void)
+{
+  return (stopsec -startsec)*1000.0
+         + (double)(stopnsec -startnsec)/1000000.0;
+}
+
+static double fPi( double x) { return 4.0/(1.0+x*x); }
+static double fSqrt( double x) { return sqrt(x); }
+static double fOsc( double x) { return x*sin(30.0*x); }
+
+typedef struct {
+  const char *expr;
+  double (*f)( double);
+  double a, b;
+  double exact;
+} testcase;
+
+static const char *ruleNames[] = { "midpoint", "simpson", "gauss-kronrod" };
+
+int main (int argc, char * argv[])
+{
+  long long n = (argc > 1 ? (long long) atof( argv[1]) : 10000000LL);
+  double tol = (argc > 2 ? atof( argv[2]) : 1e-12);
+  int devType = (argc > 3 ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU);
+  testcase tests[3] = {
+    { "4.0/(1.0+x*x)", fPi, 0.0, 1.0, M_PI },
+    { "sqrt(x)", fSqrt, 0.0, 1.0, 2.0/3.0 },
+    { "x*sin(30.0*x)", fOsc, 0.0, 1.0, sin(30.0)/900.0 - cos(30.0)/30.0 }
+  };
+  cl_platform_id platform;
+  cl_device_id device_id;
+  cl_context context;
+  cl_command_queue commands;
+  cl_int err;
+
+  err = clGetPlatformIDs (1, &platform, NULL);
+  err |= clGetDeviceIDs (platform, devType, 1, &device_id, NULL);
+  if (err != CL_SUCCESS) {
+    die( "Error: Failed to find a device!");
+    return 1;
+  }
+  context = clCreateContext (0, 1, &device_id, NULL, NULL, &err);
+  commands = clCreateCommandQueue (context, device_id, 0, &err);
+  integrateSetDevice( context, device_id, commands);
+
+  printf( "%lld panels for the fixed rules, tolerance %g and 16 initial intervals for the adaptive one\n",
+          n, tol);
+  printf( "%-15s %-14s %-7s %22s %11s %11s %12s\n",
+          "integrand", "rule", "where", "value", "error", "estimate", "time [ms]");
+  for (int t = 0; t < 3; t++) {
+    for (int rule = INTEGRATE_MIDPOINT; rule <= INTEGRATE_GAUSS_KRONROD; rule++) {
+      long long panels = (rule == INTEGRATE_GAUSS_KRONROD ? 16 : n);
+      double value, estimate;
+
+      TIMERwc_time( &startsec, &startnsec);
+      integrateHost( tests[t].f, rule, tests[t].a, tests[t].b, panels, tol, &value, &estimate);
+      TIMERwc_time( &stopsec, &stopnsec);
+      printf( "%-15s %-14s %-7s %22.16f %11.3e %11.3e %12.3f\n", tests[t].expr, ruleNames[rule],
+              "host", value, fabs( value - tests[t].exact), estimate, elapsedMsec());
+
+      /* the first call of each integrand and rule includes the build */
+      TIMERwc_time( &startsec, &startnsec);
+      err = integrate( tests[t].expr, rule, tests[t].a, tests[t].b, panels, tol, &value, &estimate);
+      TIMERwc_time( &stopsec, &stopnsec);
+      if (err != CL_SUCCESS) {
+        die( "Error: integrate failed with %d!", err);
+        continue;
+      }
+      printf( "%-15s %-14s %-7s %22.16f %11.3e %11.3e %12.3f\n", tests[t].expr, ruleNames[rule],
+              "device", value, fabs( value - tests[t].exact), estimate, elapsedMsec());
+    }
+  }
+
+  integrateRelease();
+  clReleaseCommandQueue (commands);
+  clReleaseContext (context);
+
+  return 0;
+}
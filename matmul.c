@@ -11,8 +11,10 @@
 #include "timer.h"
 #include "math.h"
 #include "simple.h"
+#include "philox.h"
 
 #define DATA_SIZE 1024
+#define SEED 42
 
 const char *KernelSource =                 "\n"
   "__kernel void matmul(                    \n"
@@ -94,11 +96,9 @@ int main (int argc, char * argv[])
   in_b = (float *) malloc (count * count * sizeof (float));
   out = (float *) malloc (count * count * sizeof (float));
 
-  /* Fill the vector with random float values.  */
-  for (int i = 0; i < count*count; i++) {
-    in_a[i] = rand () / (float) RAND_MAX;
-    in_b[i] = rand () / (float) RAND_MAX;
-  }
+  /* Fill the vector with random float values; b continues a's stream.  */
+  philoxUniform( SEED, 0, in_a, count*count);
+  philoxUniform( SEED, (uint64_t)count*count, in_b, count*count);
 
   TIMERwc_time( &startsec, &startnsec);
 
@@ -1,3 +1,27 @@
+// Division mode, selected when building the program with -DDIV_MODE=n:
+//   0: IEEE division (2.5 ulp)
+//   1: native_divide, accuracy implementation-defined
+//   2: half_divide, at least 10 bits
+//   3: native_recip refined by one Newton-Raphson step, then a multiply
+#ifndef DIV_MODE
+#define DIV_MODE 0
+#endif
+
+static inline float mdd_div(float a, float b) {
+#if DIV_MODE == 1
+    return native_divide(a, b);
+#elif DIV_MODE == 2
+    return half_divide(a, b);
+#elif DIV_MODE == 3
+    // r' = r + r*(1 - b*r) doubles the number of correct bits of r
+    float r = native_recip(b);
+    r = fma(r, fma(-b, r, 1.0f), r);
+    return a * r;
+#else
+    return a / b;
+#endif
+}
+
 // OpenCL kernel. Each work item takes care of one element of c
 __kernel void matrix_dot_div(const int RowSize, const int ColSize,
                              const __global float *A,
@@ -9,7 +33,29 @@ __kernel void matrix_dot_div(const int RowSize, const int ColSize,
     const int row = get_global_id(1);
     
     // Computation
-    C[row*ColSize+col] = A[row*ColSize+col] / B[row*ColSize+col];
+    C[row*ColSize+col] = mdd_div(A[row*ColSize+col], B[row*ColSize+col]);
     
 }
   
+
+// Same on strided views: element (row,col) of X is X[offX + row*rsX + col*csX].
+// A stride of 0 repeats a row (rsX = 0) or a column (csX = 0), so a matrix
+// can be divided by a row or column vector, or a sub-matrix can be used,
+// without materialising a full-size copy.
+__kernel void matrix_dot_div_view(const int RowSize, const int ColSize,
+                                  const __global float *A,
+                                  const int offA, const int rsA, const int csA,
+                                  const __global float *B,
+                                  const int offB, const int rsB, const int csB,
+                                  __global float *C,
+                                  const int offC, const int rsC, const int csC) {
+    
+    // Indexing
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    
+    // Computation
+    if (row < RowSize && col < ColSize)
+        C[offC+row*rsC+col*csC] = mdd_div(A[offA+row*rsA+col*csA], B[offB+row*rsB+col*csB]);
+    
+}
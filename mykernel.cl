@@ -1,60 +1,128 @@
-__kernel void calculatePi(int numIterations, __global float *outputPi, __local float* local_result, int numWorkers)
+// Accumulation mode, selected when building with -DPI_MODE=n:
+//   0: float
+//   1: double (needs cl_khr_fp64)
+//   2: float-float, a float sum with a Neumaier compensation term
+#ifndef PI_MODE
+#define PI_MODE 0
+#endif
+
+#if PI_MODE == 1
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+typedef double real_t;
+typedef double acc_t;
+#define ACC_ZERO 0.0
+#define ACC_ADD(a, x) ((a) + (x))
+#define ACC_COMBINE(a, b) ((a) + (b))
+#elif PI_MODE == 2
+typedef float real_t;
+typedef float2 acc_t;           // (sum, compensation)
+#define ACC_ZERO ((float2)(0.0f, 0.0f))
+#define ACC_ADD(a, x) neumaierAdd(a, x)
+#define ACC_COMBINE(a, b) neumaierAdd(neumaierAdd(a, (b).x), (b).y)
+
+// Adds x to the compensated sum a; the rounding error of every addition
+// is collected in a.y and only added to the sum at the end.
+float2 neumaierAdd(float2 a, float x)
 {
-    __private const uint gid = get_global_id(0);
+    float t = a.x + x;
+    if (fabs(a.x) >= fabs(x))
+        a.y += (a.x - t) + x;
+    else
+        a.y += (x - t) + a.x;
+    a.x = t;
+    return a;
+}
+#else
+typedef float real_t;
+typedef float acc_t;
+#define ACC_ZERO 0.0f
+#define ACC_ADD(a, x) ((a) + (x))
+#define ACC_COMBINE(a, b) ((a) + (b))
+#endif
+
+// Sum of the values of all work-items of a work-group, returned to every
+// work-item. scratch needs one acc_t per work-item. The tree halves the
+// number of active work-items in each step and works for any group size.
+acc_t groupSum(acc_t value, __local acc_t* scratch)
+{
+#if __OPENCL_C_VERSION__ >= 200 && PI_MODE != 2
+    return work_group_reduce_add(value);
+#else
     __private const uint lid = get_local_id(0);
-    __private float offset = numIterations*gid*2;
-    __private float sum = 0.0f;
-    __private int i;
-    __private float float_i;
-    
-    // Have the last worker initialize local_result
-    if (gid == numWorkers-1)
+    __private uint n = get_local_size(0);
+
+    scratch[lid] = value;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    while (n > 1)
     {
-        for (i = 0; i < numWorkers; i++)
+        __private uint h = (n + 1) / 2;
+        if (lid < n - h)
         {
-            local_result[i] = 0.0f;
+            scratch[lid] = ACC_COMBINE(scratch[lid], scratch[lid + h]);
         }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        n = h;
     }
-    
-    // Have all workers wait until this is completed
+    value = scratch[0];
+    // scratch may be reused right after the call
     barrier(CLK_LOCAL_MEM_FENCE);
-    
-    
-    // Have each worker calculate their portion of pi
-    // This is a private value
-    for (i = 0; i < numIterations; i++)
+    return value;
+#endif
+}
+
+// Each worker sums pairsPerWorker consecutive pairs of terms of the
+// Leibniz series 4 * sum_k (-1)^k / (2k+1), up to numPairs pairs. A pair
+// k = 2j, 2j+1 is added as 8 / ((4j+1)(4j+3)): adding the alternating
+// terms separately would lose their difference to rounding once 2k+1
+// no longer fits the mantissa. The work-group's total goes to
+// partialSums[group id]. With more than one work-group reducePartials
+// adds those up.
+__kernel void calculatePi(ulong numPairs, ulong pairsPerWorker, __global acc_t *partialSums, __local acc_t* local_result)
+{
+    __private const ulong first = get_global_id(0) * pairsPerWorker;
+    __private ulong last = first + pairsPerWorker;
+    __private acc_t sum = ACC_ZERO;
+    __private ulong j;
+    __private real_t real_j;
+
+    if (last > numPairs)
     {
-        float_i = i;
-        
-        if (i % 2 == 0)
-        {
-            sum += 4.0 * 1.0 / (1 + 2*float_i + offset);
-        }
-        else
-        {
-            sum -= 4.0 * 1.0 / (1 + 2*float_i + offset);
-        }
+        last = numPairs;
     }
-    
-    // Have each worker move their value to the appropriate
-    // local_result slot so that the first worker can see it
-    // when reducing next
-    local_result[gid] = sum;
-    
-    // Make sure all workers complete this task before continuing
-    barrier(CLK_LOCAL_MEM_FENCE);
-    
-    // Have the last worker add up all of the other worker's values
-    // to get the final value
-    // Last worker use verifies that the worker and memory allocation are correct
-    if (gid == numWorkers-1)
+
+    // Have each worker calculate their portion of pi, smallest terms
+    // first. This is a private value
+    for (j = last; j > first; j--)
     {
-        outputPi[0] = 0;
-        for (i = 0; i < numWorkers; i++)
-        {
-            outputPi[0] += local_result[i];
-        }
+        real_j = j - 1;
+        sum = ACC_ADD(sum, 8 / ((4*real_j + 1) * (4*real_j + 3)));
+    }
+
+    // Tree reduction within the work-group, one partial sum per group
+    sum = groupSum(sum, local_result);
+    if (get_local_id(0) == 0)
+    {
+        partialSums[get_group_id(0)] = sum;
+    }
+}
+
+// One pass of the second stage: every work-item adds up every
+// global_size-th of the n input values (coalesced loads), then each
+// work-group writes one output value. Repeated passes reduce any number
+// of partial sums in logarithmic steps.
+__kernel void reducePartials(__global const acc_t *in, uint n, __global acc_t *out, __local acc_t* scratch)
+{
+    __private acc_t sum = ACC_ZERO;
+    __private uint i;
+
+    for (i = get_global_id(0); i < n; i += get_global_size(0))
+    {
+        sum = ACC_COMBINE(sum, in[i]);
+    }
+
+    sum = groupSum(sum, scratch);
+    if (get_local_id(0) == 0)
+    {
+        out[get_group_id(0)] = sum;
     }
-    
-    barrier(CLK_GLOBAL_MEM_FENCE);
 }
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "permute.h"
+#include "transpose_host.h"
+
+#define TILE 32
+#define TILE_ROWS 8
+
+enum { PERMUTE_COPY, PERMUTE_ROWS, PERMUTE_TILED };
+
+typedef struct permute_plan {
+  /* key: canonical shape and permutation */
+  int ndims;
+  size_t dims[PERMUTE_MAX_DIMS];
+  int perm[PERMUTE_MAX_DIMS];
+
+  int kind;
+  size_t total;
+  size_t da, db;                        /* tile extents (DB is innermost in) */
+  size_t is_a, os_b;                    /* strides of the tile axes */
+  int nbatch_axes;
+  size_t bdim[PERMUTE_MAX_DIMS];        /* batch axes, fastest first */
+  size_t bis[PERMUTE_MAX_DIMS];
+  size_t bos[PERMUTE_MAX_DIMS];
+  size_t nbatch;
+
+  cl_program program;
+  cl_kernel kernel;
+
+  struct permute_plan *next;
+} permute_plan;
+
+static permute_plan *plans = NULL;
+
+static cl_context context = NULL;
+static cl_device_id device = NULL;
+static cl_command_queue queue = NULL;
+
+const char *PermuteKernelSource =                                        "\n"
+  "__kernel void permuteTiled(                                            \n"
+  "   __global const float* in,                                           \n"
+  "   __global float* out)                                                \n"
+  "{                                                                      \n"
+  "   __local float tile[TILE*(TILE+1)];                                  \n"
+  "   int lx = get_local_id(0);                                           \n"
+  "   int ly = get_local_id(1);                                           \n"
+  "   size_t in_off = 0, out_off = 0;                                     \n"
+  "   BATCH_OFFSETS( get_global_id(2), in_off, out_off);                  \n"
+  "                                                                       \n"
+  "   size_t x0 = get_group_id(0)*TILE;                                   \n"
+  "   size_t y0 = get_group_id(1)*TILE;                                   \n"
+  "     for( int k=0; k<TILE; k+=TILE_ROWS) {                             \n"
+  "       size_t x = x0+lx, y = y0+ly+k;                                  \n"
+  "       if( x < DB && y < DA)                                           \n"
+  "         tile[(ly+k)*(TILE+1)+lx] = in[in_off + y*IS_A + x];           \n"
+  "     }                                                                 \n"
+  "     barrier( CLK_LOCAL_MEM_FENCE);                                    \n"
+  "     for( int k=0; k<TILE; k+=TILE_ROWS) {                             \n"
+  "       size_t x = y0+lx, y = x0+ly+k;                                  \n"
+  "       if( x < DA && y < DB)                                           \n"
+  "         out[out_off + y*OS_B + x] = tile[lx*(TILE+1)+ly+k];           \n"
+  "     }                                                                 \n"
+  "}                                                                      \n"
+  "                                                                       \n"
+  "__kernel void permuteRows(                                             \n"
+  "   __global const float* in,                                           \n"
+  "   __global float* out)                                                \n"
+  "{                                                                      \n"
+  "   size_t x = get_global_id(0);                                        \n"
+  "   size_t in_off = 0, out_off = 0;                                     \n"
+  "   BATCH_OFFSETS( get_global_id(1), in_off, out_off);                  \n"
+  "     if( x < DB)                                                       \n"
+  "       out[out_off + x] = in[in_off + x];                              \n"
+  "}                                                                      \n"
+  "\n";
+
+void permuteSetDevice( cl_context ctx, cl_device_id dev, cl_command_queue q)
+{
+  if (ctx != context)
+    permuteRelease();
+  context = ctx;
+  device = dev;
+  queue = q;
+}
+
+/* Drops size-1 axes and fuses input axes a, a+1 that are adjacent in perm.
+ * Returns the canonical number of axes, -1 if perm is invalid.  */
+static int canonicalize( int n, const size_t *dims, const int *perm, size_t *cd, int *cp)
+{
+  int map[PERMUTE_MAX_DIMS];
+  int seen[PERMUTE_MAX_DIMS] = {0};
+  int m = 0, q = 0;
+
+  if (n < 0 || n > PERMUTE_MAX_DIMS)
+    return -1;
+  for (int k = 0; k < n; k++) {
+    if (perm[k] < 0 || perm[k] >= n || seen[perm[k]])
+      return -1;
+    seen[perm[k]] = 1;
+  }
+
+  for (int a = 0; a < n; a++) {
+    if (dims[a] == 1) {
+      map[a] = -1;
+    } else {
+      map[a] = m;
+      cd[m++] = dims[a];
+    }
+  }
+  for (int k = 0; k < n; k++)
+    if (map[perm[k]] >= 0)
+      cp[q++] = map[perm[k]];
+
+  for (int k = 0; k+1 < m; ) {
+    if (cp[k]+1 != cp[k+1]) {
+      k++;
+      continue;
+    }
+    int a = cp[k];
+    cd[a] *= cd[a+1];
+    for (int i = a+1; i+1 < m; i++)
+      cd[i] = cd[i+1];
+    for (int i = k+1; i+1 < m; i++)
+      cp[i] = cp[i+1];
+    m--;
+    for (int i = 0; i < m; i++)
+      if (cp[i] > a)
+        cp[i]--;
+  }
+  return m;
+}
+
+static permute_plan *findPlan( int n, const size_t *cd, const int *cp)
+{
+  for (permute_plan *p = plans; p != NULL; p = p->next)
+    if (p->ndims == n
+        && memcmp( p->dims, cd, n * sizeof (size_t)) == 0
+        && memcmp( p->perm, cp, n * sizeof (int)) == 0)
+      return p;
+  return NULL;
+}
+
+static permute_plan *makePlan( int n, const size_t *cd, const int *cp)
+{
+  permute_plan *p = (permute_plan *) calloc (1, sizeof (permute_plan));
+  size_t istr[PERMUTE_MAX_DIMS], ostr[PERMUTE_MAX_DIMS];
+  size_t s;
+  int a;
+
+  p->ndims = n;
+  memcpy( p->dims, cd, n * sizeof (size_t));
+  memcpy( p->perm, cp, n * sizeof (int));
+
+  /* strides of every input axis in the input and in the output */
+  s = 1;
+  for (int k = n-1; k >= 0; k--) {
+    istr[k] = s;
+    s *= cd[k];
+  }
+  p->total = s;
+  s = 1;
+  for (int k = n-1; k >= 0; k--) {
+    ostr[cp[k]] = s;
+    s *= cd[cp[k]];
+  }
+
+  if (n <= 1) {
+    p->kind = PERMUTE_COPY;
+    p->nbatch = 1;
+    return p;
+  }
+
+  a = cp[n-1];
+  p->kind = (a == n-1 ? PERMUTE_ROWS : PERMUTE_TILED);
+  p->db = cd[n-1];
+  p->da = cd[a];
+  p->is_a = istr[a];
+  p->os_b = ostr[n-1];
+
+  /* everything but the tile axes is batch, fastest varying first */
+  p->nbatch = 1;
+  for (int k = n-2; k >= 0; k--) {
+    if (p->kind == PERMUTE_TILED && k == a)
+      continue;
+    p->bdim[p->nbatch_axes] = cd[k];
+    p->bis[p->nbatch_axes] = istr[k];
+    p->bos[p->nbatch_axes] = ostr[k];
+    p->nbatch_axes++;
+    p->nbatch *= cd[k];
+  }
+  if (p->kind == PERMUTE_ROWS)
+    p->da = 1;
+
+  return p;
+}
+
+static void batchOffsets( const permute_plan *p, size_t b, size_t *in_off, size_t *out_off)
+{
+  *in_off = 0;
+  *out_off = 0;
+  for (int k = 0; k < p->nbatch_axes; k++) {
+    size_t idx = b % p->bdim[k];
+    b /= p->bdim[k];
+    *in_off += idx * p->bis[k];
+    *out_off += idx * p->bos[k];
+  }
+}
+
+/* specialise the kernels for the plan's shape; the index arithmetic then
+ * only involves compile time constants */
+static cl_int buildPlan( permute_plan *p)
+{
+  char *src, *pos;
+  size_t len = strlen( PermuteKernelSource) + 4096;
+  cl_int err;
+
+  src = pos = (char *) malloc (len);
+  pos += sprintf( pos, "#define TILE %d\n#define TILE_ROWS %d\n", TILE, TILE_ROWS);
+  pos += sprintf( pos, "#define DA %luUL\n#define DB %luUL\n#define IS_A %luUL\n#define OS_B %luUL\n",
+                  (unsigned long)p->da, (unsigned long)p->db,
+                  (unsigned long)p->is_a, (unsigned long)p->os_b);
+  pos += sprintf( pos, "#define BATCH_OFFSETS(b, in_off, out_off) { size_t r_ = (b), i_;");
+  for (int k = 0; k < p->nbatch_axes; k++)
+    pos += sprintf( pos, " i_ = r_ %% %luUL; r_ /= %luUL; in_off += i_*%luUL; out_off += i_*%luUL;",
+                    (unsigned long)p->bdim[k], (unsigned long)p->bdim[k],
+                    (unsigned long)p->bis[k], (unsigned long)p->bos[k]);
+  pos += sprintf( pos, " }\n");
+  strcpy( pos, PermuteKernelSource);
+
+  p->program = clCreateProgramWithSource (context, 1, (const char **) &src, NULL, &err);
+  free( src);
+  if (err != CL_SUCCESS)
+    return err;
+  err = clBuildProgram (p->program, 1, &device, NULL, NULL, NULL);
+  if (err != CL_SUCCESS) {
+    char buffer[2048];
+
+    clGetProgramBuildInfo (p->program, device, CL_PROGRAM_BUILD_LOG,
+                           sizeof (buffer), buffer, NULL);
+    fprintf( stderr, "Error: Failed to build permute kernel!\n%s\n", buffer);
+    return err;
+  }
+  p->kernel = clCreateKernel (p->program,
+                              p->kind == PERMUTE_TILED ? "permuteTiled" : "permuteRows", &err);
+  return err;
+}
+
+static permute_plan *getPlan( int ndims, const size_t *dims, const int *perm)
+{
+  size_t cd[PERMUTE_MAX_DIMS];
+  int cp[PERMUTE_MAX_DIMS];
+  int n = canonicalize( ndims, dims, perm, cd, cp);
+  permute_plan *p;
+
+  if (n < 0)
+    return NULL;
+  p = findPlan( n, cd, cp);
+  if (p == NULL) {
+    p = makePlan( n, cd, cp);
+    p->next = plans;
+    plans = p;
+  }
+  return p;
+}
+
+cl_int permute( cl_mem src, cl_mem dst, int ndims, const size_t *dims, const int *perm)
+{
+  permute_plan *p = getPlan( ndims, dims, perm);
+  size_t global[3], local[3];
+  cl_int err;
+
+  if (p == NULL)
+    return CL_INVALID_VALUE;
+  if (p->kind == PERMUTE_COPY)
+    return clEnqueueCopyBuffer (queue, src, dst, 0, 0, p->total * sizeof (float), 0, NULL, NULL);
+
+  if (p->kernel == NULL && (err = buildPlan( p)) != CL_SUCCESS)
+    return err;
+
+  err = clSetKernelArg (p->kernel, 0, sizeof (cl_mem), &src);
+  err |= clSetKernelArg (p->kernel, 1, sizeof (cl_mem), &dst);
+  if (err != CL_SUCCESS)
+    return err;
+
+  if (p->kind == PERMUTE_TILED) {
+    local[0] = TILE;
+    local[1] = TILE_ROWS;
+    local[2] = 1;
+    global[0] = (p->db + TILE - 1) / TILE * TILE;
+    global[1] = (p->da + TILE - 1) / TILE * TILE_ROWS;
+    global[2] = p->nbatch;
+    return clEnqueueNDRangeKernel (queue, p->kernel, 3, NULL, global, local, 0, NULL, NULL);
+  } else {
+    local[0] = 64;
+    local[1] = 1;
+    global[0] = (p->db + 63) / 64 * 64;
+    global[1] = p->nbatch;
+    return clEnqueueNDRangeKernel (queue, p->kernel, 2, NULL, global, local, 0, NULL, NULL);
+  }
+}
+
+int permuteHost( const float *src, float *dst, int ndims, const size_t *dims, const int *perm)
+{
+  permute_plan *p = getPlan( ndims, dims, perm);
+  long nbatch;
+
+  if (p == NULL)
+    return -1;
+  if (p->kind == PERMUTE_COPY) {
+    memcpy( dst, src, p->total * sizeof (float));
+    return 0;
+  }
+
+  nbatch = p->nbatch;
+  if (p->kind == PERMUTE_TILED && nbatch == 1) {
+    /* a single transpose, let it use all threads */
+    transposeHostStrided( src, p->is_a, dst, p->os_b, p->da, p->db, 0);
+    return 0;
+  }
+
+#pragma omp parallel for schedule(static)
+  for (long b = 0; b < nbatch; b++) {
+    size_t in_off, out_off;
+
+    batchOffsets( p, b, &in_off, &out_off);
+    if (p->kind == PERMUTE_TILED)
+      transposeHostStrided( src + in_off, p->is_a, dst + out_off, p->os_b, p->da, p->db, 0);
+    else
+      memcpy( dst + out_off, src + in_off, p->db * sizeof (float));
+  }
+  return 0;
+}
+
+void permuteRelease( void)
+{
+  while (plans != NULL) {
+    permute_plan *p = plans;
+
+    plans = p->next;
+    if (p->kernel != NULL)
+      clReleaseKernel (p->kernel);
+    if (p->program != NULL)
+      clReleaseProgram (p->program);
+    free( p);
+  }
+}
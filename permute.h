@@ -0,0 +1,39 @@
+#ifndef PERMUTE_H
+#define PERMUTE_H
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+/* Axis permutation of dense row-major float tensors (numpy transpose
+ * semantics): the output has dims[perm[k]] as its k-th dimension and
+ * out[..., i_k, ...] = in[..., i_perm[k], ...].
+ *
+ * Size-1 axes are dropped and axes that stay adjacent are fused, so e.g.
+ * NCHW -> NHWC becomes a batch of N transposes of C x (H*W). What is left
+ * maps onto one of
+ *   - a plain copy,
+ *   - a batched row copy (innermost axis unchanged),
+ *   - a batched padded-tile transpose of the input's innermost axis with
+ *     the output's innermost axis; all other axes form the batch.
+ * Plans, including a device program specialised for the shape, are cached
+ * per canonical shape and permutation.
+ */
+
+#define PERMUTE_MAX_DIMS 8
+
+/* device to use for permute(); the queue must belong to the context */
+void permuteSetDevice( cl_context context, cl_device_id device, cl_command_queue queue);
+
+/* both return an error (CL_INVALID_VALUE, resp. -1) if perm is not a
+ * permutation of 0..ndims-1 */
+cl_int permute( cl_mem src, cl_mem dst, int ndims, const size_t *dims, const int *perm);
+
+int permuteHost( const float *src, float *dst, int ndims, const size_t *dims, const int *perm);
+
+/* releases all cached plans and their programs */
+void permuteRelease( void);
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "timer.h"
+#include "permute.h"
+
+/* Permutes a 4-D float tensor (default NCHW -> NHWC) with a scalar host
+ * loop, with permuteHost() and with permute() on the device.
+ *
+ * usage: permute_demo [d0 d1 d2 d3 p0 p1 p2 p3 [cpu]]
+ */
+
+#define die(msg, ...) do {                      \
+  (void) fprintf (stderr, msg, ## __VA_ARGS__); \
+  (void) fprintf (stderr, "\n");                \
+} while (0)
+
+int startsec, startnsec, stopsec, stopnsec;
+
+void printTimeElapsed( char *text)
+{
+  double elapsed = (stopsec -startsec)*1000.0
+                  + (double)(stopnsec -startnsec)/1000000.0;
+  printf( "%s: %f msec\n", text, elapsed);
+}
+
+/* the loop nest this replaces */
+void permuteScalar( const float *in, float *out, const size_t *d, const int *p)
+{
+  size_t od[4], is[4], idx[4];
+  size_t o = 0;
+
+  is[3] = 1;
+  for (int k = 2; k >= 0; k--)
+    is[k] = is[k+1] * d[k+1];
+  for (int k = 0; k < 4; k++)
+    od[k] = d[p[k]];
+
+  for (idx[0] = 0; idx[0] < od[0]; idx[0]++)
+    for (idx[1] = 0; idx[1] < od[1]; idx[1]++)
+      for (idx[2] = 0; idx[2] < od[2]; idx[2]++)
+        for (idx[3] = 0; idx[3] < od[3]; idx[3]++)
+          out[o++] = in[idx[0]*is[p[0]] + idx[1]*is[p[1]] + idx[2]*is[p[2]] + idx[3]*is[p[3]]];
+}
+
+int main (int argc, char * argv[])
+{
+  size_t dims[4] = { 32, 64, 56, 56 };
+  int perm[4] = { 0, 2, 3, 1 };
+  int devType = CL_DEVICE_TYPE_GPU;
+  cl_int err;
+
+  if (argc > 8) {
+    for (int k = 0; k < 4; k++) {
+      dims[k] = atol( argv[1+k]);
+      perm[k] = atoi( argv[5+k]);
+    }
+  }
+  if (argc > 9)
+    devType = CL_DEVICE_TYPE_CPU;
+
+  size_t count = dims[0]*dims[1]*dims[2]*dims[3];
+  size_t bytes = count * sizeof (float);
+  float *data = (float *) malloc (bytes);
+  float *expected = (float *) malloc (bytes);
+  float *results = (float *) malloc (bytes);
+  size_t correct;
+
+  printf( "permuting %lu x %lu x %lu x %lu by (%d %d %d %d)\n",
+          (unsigned long)dims[0], (unsigned long)dims[1], (unsigned long)dims[2],
+          (unsigned long)dims[3], perm[0], perm[1], perm[2], perm[3]);
+
+  for (size_t i = 0; i < count; i++)
+    data[i] = rand () / (float) RAND_MAX;
+
+  TIMERwc_time( &startsec, &startnsec);
+  permuteScalar( data, expected, dims, perm);
+  TIMERwc_time( &stopsec, &stopnsec);
+  printTimeElapsed( "scalar loop on host");
+
+  TIMERwc_time( &startsec, &startnsec);
+  if (permuteHost( data, results, 4, dims, perm) != 0) {
+    die( "Error: (%d %d %d %d) is not a permutation!", perm[0], perm[1], perm[2], perm[3]);
+    return 1;
+  }
+  TIMERwc_time( &stopsec, &stopnsec);
+  printTimeElapsed( "permuteHost");
+
+  correct = 0;
+  for (size_t i = 0; i < count; i++)
+    if (results[i] == expected[i])
+      correct++;
+  printf ("Host computed %lu/%lu correct values\n", (unsigned long)correct, (unsigned long)count);
+
+  cl_platform_id platform;
+  cl_device_id device_id;
+  cl_context context;
+  cl_command_queue commands;
+  cl_mem d_in, d_out;
+
+  err = clGetPlatformIDs (1, &platform, NULL);
+  err |= clGetDeviceIDs (platform, devType, 1, &device_id, NULL);
+  if (err != CL_SUCCESS) {
+    die( "Error: Failed to find a device!");
+    return 1;
+  }
+  context = clCreateContext (0, 1, &device_id, NULL, NULL, &err);
+  commands = clCreateCommandQueue (context, device_id, 0, &err);
+  d_in = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, data, &err);
+  d_out = clCreateBuffer (context, CL_MEM_WRITE_ONLY, bytes, NULL, &err);
+  permuteSetDevice( context, device_id, commands);
+
+  /* the first call builds the plan, the second one hits the cache */
+  for (int run = 0; run < 2; run++) {
+    TIMERwc_time( &startsec, &startnsec);
+    err = permute( d_in, d_out, 4, dims, perm);
+    clFinish (commands);
+    TIMERwc_time( &stopsec, &stopnsec);
+    if (err != CL_SUCCESS)
+      die( "Error: permute failed with %d!", err);
+    printTimeElapsed( run == 0 ? "permute on device (incl. plan)" : "permute on device (cached)");
+  }
+
+  err = clEnqueueReadBuffer (commands, d_out, CL_TRUE, 0, bytes, results, 0, NULL, NULL);
+  correct = 0;
+  for (size_t i = 0; i < count; i++)
+    if (results[i] == expected[i])
+      correct++;
+  printf ("Device computed %lu/%lu correct values\n", (unsigned long)correct, (unsigned long)count);
+
+  permuteRelease();
+  clReleaseMemObject (d_in);
+  clReleaseMemObject (d_out);
+  clReleaseCommandQueue (commands);
+  clReleaseContext (context);
+  free( data);
+  free( expected);
+  free( results);
+
+  return 0;
+}
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "philox.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+/* blocks generated together; the round loops over them vectorise
+ * (32x32->64 bit multiplies) */
+#define PHILOX_LANES 16
+
+static cl_context context = NULL;
+static cl_device_id device = NULL;
+static cl_command_queue queue = NULL;
+static cl_program program = NULL;
+static cl_kernel kernel = NULL;
+
+const char *PhiloxKernelSource =                                         "\n"
+  "__kernel void philoxUniform(                                           \n"
+  "   __global float* out,                                                \n"
+  "   const ulong offset,                                                 \n"
+  "   const ulong n,                                                      \n"
+  "   const uint k0,                                                      \n"
+  "   const uint k1)                                                      \n"
+  "{                                                                      \n"
+  "   ulong b = offset/4 + get_global_id(0);                              \n"
+  "   uint c0 = (uint)b, c1 = (uint)(b >> 32), c2 = 0, c3 = 0;            \n"
+  "   uint key0 = k0, key1 = k1;                                          \n"
+  "     for( int r=0; r<10; r++) {                                        \n"
+  "       uint hi0 = mul_hi( 0xD2511F53u, c0), lo0 = 0xD2511F53u*c0;      \n"
+  "       uint hi1 = mul_hi( 0xCD9E8D57u, c2), lo1 = 0xCD9E8D57u*c2;      \n"
+  "       c0 = hi1 ^ c1 ^ key0;                                           \n"
+  "       c1 = lo1;                                                       \n"
+  "       c2 = hi0 ^ c3 ^ key1;                                           \n"
+  "       c3 = lo0;                                                       \n"
+  "       key0 += 0x9E3779B9u;                                            \n"
+  "       key1 += 0xBB67AE85u;                                            \n"
+  "     }                                                                 \n"
+  "   uint x[4] = { c0, c1, c2, c3 };                                     \n"
+  "     for( int w=0; w<4; w++) {                                         \n"
+  "       ulong e = b*4 + w;                                              \n"
+  "       if( e >= offset && e - offset < n)                              \n"
+  "         out[e - offset] = (x[w] >> 8) * (1.0f/16777216.0f);           \n"
+  "     }                                                                 \n"
+  "}                                                                      \n"
+  "\n";
+
+void philox4x32( const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4])
+{
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = key[0], k1 = key[1];
+
+  for (int r = 0; r < PHILOX_ROUNDS; r++) {
+    uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+    uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+    c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+    c1 = (uint32_t) p1;
+    c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+    c3 = (uint32_t) p0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+/* PHILOX_LANES consecutive blocks starting at counter b, word-major */
+static void philoxLanes( uint64_t b, uint32_t k0, uint32_t k1, uint32_t x[4][PHILOX_LANES])
+{
+  uint32_t c0[PHILOX_LANES], c1[PHILOX_LANES], c2[PHILOX_LANES], c3[PHILOX_LANES];
+
+  for (int l = 0; l < PHILOX_LANES; l++) {
+    c0[l] = (uint32_t)(b + l);
+    c1[l] = (uint32_t)((b + l) >> 32);
+    c2[l] = 0;
+    c3[l] = 0;
+  }
+  for (int r = 0; r < PHILOX_ROUNDS; r++) {
+#pragma omp simd
+    for (int l = 0; l < PHILOX_LANES; l++) {
+      uint64_t p0 = (uint64_t) PHILOX_M0 * c0[l];
+      uint64_t p1 = (uint64_t) PHILOX_M1 * c2[l];
+      c0[l] = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+      c1[l] = (uint32_t) p1;
+      c2[l] = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+      c3[l] = (uint32_t) p0;
+    }
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  for (int l = 0; l < PHILOX_LANES; l++) {
+    x[0][l] = c0[l];
+    x[1][l] = c1[l];
+    x[2][l] = c2[l];
+    x[3][l] = c3[l];
+  }
+}
+
+static inline float toUniform( uint32_t x)
+{
+  return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+void philoxUniform( uint64_t seed, uint64_t offset, float *out, size_t n)
+{
+  uint32_t k0 = (uint32_t) seed, k1 = (uint32_t)(seed >> 32);
+  uint64_t first = offset / 4;
+  uint64_t nblocks = (offset + n + 3) / 4 - first;
+  long nchunks = (long)((nblocks + PHILOX_LANES - 1) / PHILOX_LANES);
+
+  if (n == 0)
+    return;
+
+  /* chunks are independent, so the split over threads does not matter */
+#pragma omp parallel for schedule(static)
+  for (long c = 0; c < nchunks; c++) {
+    uint32_t x[4][PHILOX_LANES];
+    uint64_t b = first + (uint64_t) c * PHILOX_LANES;
+    uint64_t e0 = b * 4;
+
+    philoxLanes( b, k0, k1, x);
+    if (e0 >= offset && e0 + 4*PHILOX_LANES <= offset + n) {
+      float *o = out + (e0 - offset);
+      for (int l = 0; l < PHILOX_LANES; l++)
+        for (int w = 0; w < 4; w++)
+          o[4*l + w] = toUniform( x[w][l]);
+    } else {
+      /* first or last chunk */
+      for (int l = 0; l < PHILOX_LANES; l++)
+        for (int w = 0; w < 4; w++) {
+          uint64_t e = e0 + 4*l + w;
+          if (e >= offset && e - offset < n)
+            out[e - offset] = toUniform( x[w][l]);
+        }
+    }
+  }
+}
+
+void philoxSetDevice( cl_context ctx, cl_device_id dev, cl_command_queue q)
+{
+  if (ctx != context)
+    philoxRelease();
+  context = ctx;
+  device = dev;
+  queue = q;
+}
+
+static cl_int buildKernel( void)
+{
+  cl_int err;
+
+  program = clCreateProgramWithSource (context, 1, &PhiloxKernelSource, NULL, &err);
+  if (err != CL_SUCCESS)
+    return err;
+  err = clBuildProgram (program, 1, &device, NULL, NULL, NULL);
+  if (err != CL_SUCCESS) {
+    char buffer[2048];
+
+    clGetProgramBuildInfo (program, device, CL_PROGRAM_BUILD_LOG,
+                           sizeof (buffer), buffer, NULL);
+    fprintf( stderr, "Error: Failed to build philox kernel!\n%s\n", buffer);
+    return err;
+  }
+  kernel = clCreateKernel (program, "philoxUniform", &err);
+  return err;
+}
+
+cl_int philoxUniformDevice( cl_mem buf, uint64_t seed, uint64_t offset, size_t n)
+{
+  cl_uint k0 = (cl_uint) seed, k1 = (cl_uint)(seed >> 32);
+  cl_ulong off = offset, cnt = n;
+  size_t global[1], local[1];
+  cl_int err;
+
+  if (n == 0)
+    return CL_SUCCESS;
+  if (kernel == NULL && (err = buildKernel()) != CL_SUCCESS)
+    return err;
+
+  err = clSetKernelArg (kernel, 0, sizeof (cl_mem), &buf);
+  err |= clSetKernelArg (kernel, 1, sizeof (cl_ulong), &off);
+  err |= clSetKernelArg (kernel, 2, sizeof (cl_ulong), &cnt);
+  err |= clSetKernelArg (kernel, 3, sizeof (cl_uint), &k0);
+  err |= clSetKernelArg (kernel, 4, sizeof (cl_uint), &k1);
+  if (err != CL_SUCCESS)
+    return err;
+
+  /* one work-item per block of four values */
+  local[0] = 64;
+  global[0] = ((offset + n + 3) / 4 - offset / 4 + 63) / 64 * 64;
+  return clEnqueueNDRangeKernel (queue, kernel, 1, NULL, global, local, 0, NULL, NULL);
+}
+
+void philoxRelease( void)
+{
+  if (kernel != NULL)
+    clReleaseKernel (kernel);
+  if (program != NULL)
+    clReleaseProgram (program);
+  kernel = NULL;
+  program = NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+/* Philox4x32-10 counter-based random numbers (Salmon et al., SC'11).
+ *
+ * Element e of the stream of a seed is word e%4 of the block obtained by
+ * encrypting the counter e/4 with the seed as key, so any element can be
+ * computed independently: host threads and work-items split the stream
+ * freely and the values depend only on seed and position, neither on the
+ * number of threads nor on host vs. device. Uniform floats are the top 24
+ * bits scaled to [0,1), identical on host and device.
+ */
+
+/* one block: 10 rounds over ctr with key */
+void philox4x32( const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]);
+
+/* out[i] = element offset+i of the stream of seed as a float in [0,1).
+ * Vectorised over blocks and split over the OpenMP threads.  */
+void philoxUniform( uint64_t seed, uint64_t offset, float *out, size_t n);
+
+/* device to use for philoxUniformDevice(); the queue must belong to the
+ * context */
+void philoxSetDevice( cl_context context, cl_device_id device, cl_command_queue queue);
+
+/* Same values as philoxUniform, generated in place in the first n floats
+ * of buf; nothing is transferred. Enqueued, not finished.  */
+cl_int philoxUniformDevice( cl_mem buf, uint64_t seed, uint64_t offset, size_t n);
+
+/* releases the device program */
+void philoxRelease( void);
+
+#endif
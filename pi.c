@@ -19,13 +19,31 @@ void cleanup();
 
 #define MAX_SOURCE_SIZE (0x100000)
 #define DEVICE_NAME_LEN 128
+/* values each work-item of reducePartials adds up serially */
+#define REDUCE_ITEMS 8
+/* terms of the series unless given on the command line */
+#define DEFAULT_ITERATIONS 100000000ULL
+
+/* accumulation modes of mykernel.cl, built with -DPI_MODE=n */
+#define PI_NUM_MODES 3
+static const char *modeNames[PI_NUM_MODES] = { "float", "double", "float-float" };
+#ifndef PI_MODE
+#define PI_MODE 0               /* the one mode an AOCL binary contains */
+#endif
 
 void errorCheck(cl_int ret, char *check);
 
 
 static char dev_name[DEVICE_NAME_LEN];
 
-int main()
+/*
+ * usage: pi [global_size [iterations]]
+ *   global_size defaults to num_comp_units * local_size and is rounded
+ *   up to a multiple of local_size; iterations (terms of the series,
+ *   64 bit) defaults to DEFAULT_ITERATIONS. Every accumulation mode the
+ *   device supports is run and reports its digits of accuracy per second.
+ */
+int main(int argc, char *argv[])
 {
     cl_uint platformCount;
     cl_platform_id* platforms;
@@ -36,6 +54,7 @@ int main()
     cl_command_queue command_queue = NULL;
     cl_program program = NULL;
     cl_kernel kernel = NULL;
+    cl_kernel reduce_kernel = NULL;
     
     cl_uint num_comp_units;
     size_t global_size;
@@ -93,15 +112,13 @@ int main()
     local_size = 16;
 #endif
     
-    global_size = num_comp_units * local_size;
-    printf("global_size=%lu, local_size=%lu\n", global_size, local_size);
-    
+
     /* Create OpenCL context */
     context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &ret);
     errorCheck(ret, "Create Context");
     
-    /* Create Command Queue */
-    command_queue = clCreateCommandQueue(context, device_id, 0, &ret);
+    /* Create Command Queue, profiled to time the kernels */
+    command_queue = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
     errorCheck(ret, "Create Command Queue");
     
 #ifdef __APPLE__
@@ -116,63 +133,156 @@ int main()
     source_str = (char*)malloc(MAX_SOURCE_SIZE);
     source_size = fread(source_str, 1, MAX_SOURCE_SIZE, fp);
     fclose(fp);
+#endif
     
-    /* Create Kernel Program from the source */
-    program = clCreateProgramWithSource(context, 1, (const char **)&source_str, (const size_t *)&source_size, &ret);
-    errorCheck(ret, "Create Program With Source");
-#else
+    /* the double mode needs cl_khr_fp64 */
+    cl_device_fp_config fp64_config = 0;
+    clGetDeviceInfo(device_id, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp64_config), &fp64_config, NULL);
     
+    /* terms of the series, rounded up to whole pairs */
+    cl_ulong numIterations = (argc > 2 ? strtoull(argv[2], NULL, 10) : DEFAULT_ITERATIONS);
+    cl_ulong numPairs = (numIterations + 1) / 2;
+    printf("iterations=%llu\n", (unsigned long long)(2*numPairs));
+    
+    for (int mode = 0; mode < PI_NUM_MODES; mode++)
+    {
+        size_t local = local_size;
+        
+#ifdef __APPLE__
+        if (mode == 1 && fp64_config == 0)
+        {
+            printf("%s: device has no double precision, skipped\n", modeNames[mode]);
+            continue;
+        }
+        /* Create Kernel Program from the source */
+        program = clCreateProgramWithSource(context, 1, (const char **)&source_str, (const size_t *)&source_size, &ret);
+        errorCheck(ret, "Create Program With Source");
+#else
+        
 #ifdef AOCL  /* on FPGA we need to create kernel from binary */
-    /* Create Kernel Program from the binary */
-    std::string binary_file = getBoardBinaryFile("mykernel", device_id);
-    printf("Using AOCX: %s\n", binary_file.c_str());
-    program = createProgramFromBinary(context, binary_file.c_str(), &device_id, 1);
+        /* the binary was compiled for one mode only */
+        if (mode != PI_MODE)
+            continue;
+        /* Create Kernel Program from the binary */
+        std::string binary_file = getBoardBinaryFile("mykernel", device_id);
+        printf("Using AOCX: %s\n", binary_file.c_str());
+        program = createProgramFromBinary(context, binary_file.c_str(), &device_id, 1);
 #else
 #error "unknown OpenCL SDK environment"
 #endif
-    
+        
 #endif
+        
+        /* Build Kernel Program for the accumulation mode */
+        char options[32];
+        sprintf(options, "-DPI_MODE=%d", mode);
+        ret = clBuildProgram(program, 1, &device_id, options, NULL, NULL);
+        errorCheck(ret, "Build Program");
+        
+        /* Create OpenCL Kernel */
+        kernel = clCreateKernel(program, "calculatePi", &ret);
+        errorCheck(ret, "Create Kernel");
+        reduce_kernel = clCreateKernel(program, "reducePartials", &ret);
+        errorCheck(ret, "Create Reduce Kernel");
+        
+        /* the kernels may support smaller work-groups than the device */
+        size_t kernel_wg_size;
+        clGetKernelWorkGroupInfo(kernel, device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_wg_size), &kernel_wg_size, NULL);
+        if (kernel_wg_size < local)
+            local = kernel_wg_size;
+        clGetKernelWorkGroupInfo(reduce_kernel, device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_wg_size), &kernel_wg_size, NULL);
+        if (kernel_wg_size < local)
+            local = kernel_wg_size;
+        
+        global_size = (argc > 1 ? (size_t)atol(argv[1]) : num_comp_units * local);
+        global_size = (global_size + local - 1) / local * local;
+        size_t num_groups = global_size / local;
+        cl_ulong pairsPerWorker = (numPairs + global_size - 1) / global_size;
+        printf("global_size=%lu, local_size=%lu, num_groups=%lu\n", global_size, local, num_groups);
+        
+        /* float, double or float2 partial sums */
+        size_t acc_size = (mode == 0 ? sizeof(cl_float) : sizeof(cl_double));
+        
+        /* One partial sum per work-group, and room for the first pass of
+         * the second stage */
+        cl_mem partial_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, num_groups*acc_size, NULL, &ret);
+        errorCheck(ret, "Partial Sums Buffer");
+        cl_mem pass_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, num_groups*acc_size, NULL, &ret);
+        errorCheck(ret, "Reduction Buffer");
+        
+        /* Create kernel argument */
+        ret = clSetKernelArg(kernel, 0, sizeof(cl_ulong), (void *)&numPairs);
+        ret |= clSetKernelArg(kernel, 1, sizeof(cl_ulong), (void *)&pairsPerWorker);
+        ret |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&partial_buffer);
+        ret |= clSetKernelArg(kernel, 3, local*acc_size, NULL);
+        errorCheck(ret, "Set Kernel Args");
+        
+        /* Enqueue kernel */
+        cl_event first_event, last_event;
+        ret = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_size, &local, 0, NULL, &first_event);
+        errorCheck(ret, "Kernel Enqueue");
+        last_event = first_event;
+        clRetainEvent(last_event);
+        
+        /* Second stage: each pass shrinks the partial sums by a factor of
+         * local_size * REDUCE_ITEMS, ping-ponging between the two buffers */
+        cl_mem in_buffer = partial_buffer, out_buffer = pass_buffer, tmp_buffer;
+        cl_uint n = num_groups;
+        int passes = 0;
+        while (n > 1)
+        {
+            size_t groups = (n + local*REDUCE_ITEMS - 1) / (local*REDUCE_ITEMS);
+            size_t reduce_size = groups * local;
+            
+            ret = clSetKernelArg(reduce_kernel, 0, sizeof(cl_mem), (void *)&in_buffer);
+            ret |= clSetKernelArg(reduce_kernel, 1, sizeof(cl_uint), (void *)&n);
+            ret |= clSetKernelArg(reduce_kernel, 2, sizeof(cl_mem), (void *)&out_buffer);
+            ret |= clSetKernelArg(reduce_kernel, 3, local*acc_size, NULL);
+            if (ret != CL_SUCCESS)
+                errorCheck(ret, "Set Reduce Kernel Args");
+            clReleaseEvent(last_event);
+            ret = clEnqueueNDRangeKernel(command_queue, reduce_kernel, 1, NULL, &reduce_size, &local, 0, NULL, &last_event);
+            if (ret != CL_SUCCESS)
+                errorCheck(ret, "Reduce Kernel Enqueue");
+            
+            tmp_buffer = in_buffer;
+            in_buffer = out_buffer;
+            out_buffer = tmp_buffer;
+            n = groups;
+            passes++;
+        }
+        printf("reduction passes: %d\n", passes);
+        
+        errorCheck(clFinish(command_queue), "clFinish");
+        
+        /* Read the result */
+        union { cl_float f; cl_double d; cl_float2 ff; } result;
+        ret = clEnqueueReadBuffer(command_queue, in_buffer, CL_TRUE, 0, acc_size, &result, 0, NULL, NULL);
+        errorCheck(ret, "Buffer Read");
+        double value = (mode == 0 ? result.f
+                        : mode == 1 ? result.d
+                        : (double)result.ff.s[0] + result.ff.s[1]);
+        
+        /* both stages, from the profiling information */
+        cl_ulong start, end;
+        clGetEventProfilingInfo(first_event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+        clGetEventProfilingInfo(last_event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+        double seconds = (end - start) * 1e-9;
+        double digits = -log10(fabs(value - M_PI) / M_PI);
+        
+        printf("%s: pi=%.15f error=%.3e digits=%.2f time=%.3f ms digits/s=%.1f\n",
+               modeNames[mode], value, fabs(value - M_PI), digits, seconds*1e3, digits/seconds);
+        
+        clReleaseEvent(first_event);
+        clReleaseEvent(last_event);
+        clReleaseMemObject(partial_buffer);
+        clReleaseMemObject(pass_buffer);
+        clReleaseKernel(reduce_kernel);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+    }
     
-    /* Build Kernel Program */
-    ret = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
-    errorCheck(ret, "Build Program");
-    
-    /* Create OpenCL Kernel */
-    kernel = clCreateKernel(program, "calculatePi", &ret);
-    errorCheck(ret, "Create Kernel");
-    
-    float *result = (float *) calloc(1, sizeof(float));
-    
-    /* Create buffers to hold the text characters and count */
-    cl_mem result_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(float), result, &ret);
-    errorCheck(ret, "Result Buffer");
-    
-    int numIterations[1] = {100};
-    /* Create kernel argument */
-    ret = clSetKernelArg(kernel, 0, sizeof(cl_int), (void *)&numIterations);
-    ret |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&result_buffer);
-    ret |= clSetKernelArg(kernel, 2, global_size*sizeof(cl_float), NULL);
-    ret |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void *)&global_size);
-    errorCheck(ret, "Set Kernel Args");
-    
-    /* Enqueue kernel */
-    ret = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
-    errorCheck(ret, "Kernel Enqueue");
-    
-    errorCheck(clFinish(command_queue), "clFinish");
-    
-    /* Read and print the result */
-    ret = clEnqueueReadBuffer(command_queue, result_buffer, CL_TRUE, 0, sizeof(float), result, 0, NULL, NULL);
-    errorCheck(ret, "Buffer Read");
-    
-    printf("Final calculated value: %f \n", result[0]);
-    
-    free(result);
-    
-    clReleaseMemObject(result_buffer);
     clReleaseCommandQueue(command_queue);
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
     clReleaseContext(context);
     
     return 0;
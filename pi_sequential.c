@@ -1,31 +1,64 @@
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
-int main()
+// Midpoint rule for pi = integral of 4/(1+x^2) over [0,1], split over
+// the OpenMP threads and vectorised within each thread, with a strong
+// scaling report: the same number of steps on 1, 2, 4, ... threads.
+//
+// usage: pi_sequential [num_steps [max_threads]]
+//   num_steps is 64 bit (1e10 and up work), default 1e9;
+//   max_threads defaults to omp_get_max_threads()
+
+#pragma omp declare simd
+static inline double f(double x)
+{
+  return 4.0 / (1.0 + x * x);
+}
+
+double integrate(long long num_steps, int threads)
 {
-  int num_steps = 10000;
-  double step, pi, sum;
-  step = 1.0 / num_steps;
-  double x;
-  int i;
-  double start = omp_get_wtime();
-
-  {
-    sum = 0;
-
-    for (i = 0; i < num_steps; i++)
-    {
-      x = (i + 0.5) * step;
-      double aux = 4.0 / (1.0 + x * x);
-      sum += aux;
-    }
+  double step = 1.0 / (double) num_steps;
+  double sum = 0.0;
+  long long i;
+
+#pragma omp parallel for simd num_threads(threads) schedule(static) reduction(+:sum)
+  for (i = 0; i < num_steps; i++)
+    sum += f((i + 0.5) * step);
+
+  return sum * step;
+}
+
+int main(int argc, char *argv[])
+{
+  long long num_steps = (argc > 1 ? (long long) atof(argv[1]) : 1000000000LL);
+  int max_threads = (argc > 2 ? atoi(argv[2]) : omp_get_max_threads());
+  double pi, base = 0.0;
+
+  if (num_steps < 1 || max_threads < 1) {
+    fprintf(stderr, "usage: pi_sequential [num_steps [max_threads]]\n");
+    return 1;
   }
-  pi = sum * step;
+  printf("steps = %lld\n", num_steps);
 
-  double stop = omp_get_wtime();
-  double exectime = stop - start;
+  // start the thread pool so the first measurement does not include it
+  integrate(max_threads, max_threads);
+
+  printf("%8s %12s %9s %11s %12s\n", "threads", "time [s]", "speedup", "efficiency", "error");
+  for (int t = 1; ; t = (2 * t > max_threads && t < max_threads ? max_threads : 2 * t)) {
+    double start = omp_get_wtime();
+    pi = integrate(num_steps, t);
+    double stop = omp_get_wtime();
+    double exectime = stop - start;
+
+    if (t == 1)
+      base = exectime;
+    printf("%8d %12.6f %9.2f %10.1f%% %12.3e\n", t, exectime, base / exectime,
+           100.0 * base / exectime / t, fabs(pi - M_PI));
+    if (t >= max_threads)
+      break;
+  }
 
-  printf("PI approximate = %lf\n", pi);
-  printf("Exec time = %1f\n", exectime);
+  printf("PI approximate = %.15lf\n", pi);
 }
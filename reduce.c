@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reduce.h"
+
+#define REDUCE_LOCAL 256
+#define REDUCE_GROUPS_PER_UNIT 4
+
+typedef struct reduce_program {
+  char *source;
+  cl_program program;
+  cl_kernel first, pass;
+  size_t local;                 /* work-group size both kernels support */
+  struct reduce_program *next;
+} reduce_program;
+
+static reduce_program *programs = NULL;
+
+static cl_context context = NULL;
+static cl_device_id device = NULL;
+static cl_command_queue queue = NULL;
+static cl_uint compute_units = 1;
+
+/* ping-pong buffers for the per-group values and indices */
+static cl_mem scratch_val[2] = { NULL, NULL };
+static cl_mem scratch_idx[2] = { NULL, NULL };
+static size_t scratch_groups = 0;
+
+static const struct {
+  const char *name, *zero, *max, *min;
+  size_t size;
+} types[] = {
+  { "float",  "0.0f", "INFINITY", "-INFINITY", sizeof (cl_float) },
+  { "double", "0.0",  "INFINITY", "-INFINITY", sizeof (cl_double) },
+  { "int",    "0",    "INT_MAX",  "INT_MIN",   sizeof (cl_int) },
+  { "long",   "0L",   "LONG_MAX", "LONG_MIN",  sizeof (cl_long) },
+};
+
+/* COMBINE folds (b, ib) into (a, ia); BETTER, IDENTITY, ARG, MAP and T
+ * are defined in front of this for every program */
+const char *ReduceKernelSource =                                         "\n"
+  "#if IS_SUM                                                             \n"
+  "#define COMBINE(a, ia, b, ib) { a += (b); }                            \n"
+  "#else                                                                  \n"
+  "#define COMBINE(a, ia, b, ib) { T b_ = (b); ulong ib_ = (ib);          \\\n"
+  "                                if( BETTER( b_, ib_, a, ia)) {        \\\n"
+  "                                  a = b_; ia = ib_; } }                \n"
+  "#endif                                                                 \n"
+  "                                                                       \n"
+  "void groupReduce( T acc, ulong acci, __local T* sv, __local ulong* si, \n"
+  "                  __global T* outv, __global ulong* outi)              \n"
+  "{                                                                      \n"
+  "   uint lid = get_local_id(0);                                         \n"
+  "   uint n = get_local_size(0);                                         \n"
+  "   sv[lid] = acc;                                                      \n"
+  "   si[lid] = acci;                                                     \n"
+  "   barrier( CLK_LOCAL_MEM_FENCE);                                      \n"
+  "     while( n > 1) {                                                   \n"
+  "       uint h = (n+1)/2;                                               \n"
+  "       if( lid < n-h) {                                                \n"
+  "         COMBINE( acc, acci, sv[lid+h], si[lid+h]);                    \n"
+  "         sv[lid] = acc;                                                \n"
+  "         si[lid] = acci;                                               \n"
+  "       }                                                               \n"
+  "       barrier( CLK_LOCAL_MEM_FENCE);                                  \n"
+  "       n = h;                                                          \n"
+  "     }                                                                 \n"
+  "   if( lid == 0) {                                                     \n"
+  "     outv[get_group_id(0)] = sv[0];                                    \n"
+  "#if ARG                                                                \n"
+  "     outi[get_group_id(0)] = si[0];                                    \n"
+  "#endif                                                                 \n"
+  "   }                                                                   \n"
+  "}                                                                      \n"
+  "                                                                       \n"
+  "__kernel void reduceFirst(                                             \n"
+  "   __global const T* x,                                                \n"
+  "   __global const T* y,                                                \n"
+  "   const ulong n,                                                      \n"
+  "   __global T* outv,                                                   \n"
+  "   __global ulong* outi)                                               \n"
+  "{                                                                      \n"
+  "   __local T sv[LOCAL];                                                \n"
+  "   __local ulong si[LOCAL];                                            \n"
+  "   T acc = IDENTITY;                                                   \n"
+  "   ulong acci = (ulong)-1;                                             \n"
+  "     for( ulong i = get_global_id(0); i < n; i += get_global_size(0))  \n"
+  "       COMBINE( acc, acci, (T)MAP( x[i], y[i], i), i);                 \n"
+  "   groupReduce( acc, acci, sv, si, outv, outi);                        \n"
+  "}                                                                      \n"
+  "                                                                       \n"
+  "__kernel void reducePass(                                              \n"
+  "   __global const T* inv,                                              \n"
+  "   __global const ulong* ini,                                          \n"
+  "   const ulong n,                                                      \n"
+  "   __global T* outv,                                                   \n"
+  "   __global ulong* outi)                                               \n"
+  "{                                                                      \n"
+  "   __local T sv[LOCAL];                                                \n"
+  "   __local ulong si[LOCAL];                                            \n"
+  "   T acc = IDENTITY;                                                   \n"
+  "   ulong acci = (ulong)-1;                                             \n"
+  "     for( ulong i = get_global_id(0); i < n; i += get_global_size(0))  \n"
+  "#if ARG                                                                \n"
+  "       COMBINE( acc, acci, inv[i], ini[i]);                            \n"
+  "#else                                                                  \n"
+  "       COMBINE( acc, acci, inv[i], i);                                 \n"
+  "#endif                                                                 \n"
+  "   groupReduce( acc, acci, sv, si, outv, outi);                        \n"
+  "}                                                                      \n"
+  "\n";
+
+void reduceSetDevice( cl_context ctx, cl_device_id dev, cl_command_queue q)
+{
+  if (ctx != context || dev != device)
+    reduceRelease();
+  context = ctx;
+  device = dev;
+  queue = q;
+
+  compute_units = 1;
+  clGetDeviceInfo (dev, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof (cl_uint), &compute_units, NULL);
+  if (compute_units == 0)
+    compute_units = 1;
+}
+
+static char *generate( reduce_type type, reduce_op op, const char *map)
+{
+  static const char *better[] = {
+    "0",
+    "((a) < (b))",
+    "((a) > (b))",
+    "((a) < (b) || ((a) == (b) && (ia) < (ib)))",
+    "((a) > (b) || ((a) == (b) && (ia) < (ib)))"
+  };
+  const char *identity = (op == REDUCE_SUM ? types[type].zero
+                          : op == REDUCE_MIN || op == REDUCE_ARGMIN ? types[type].max
+                          : types[type].min);
+  size_t len = strlen( ReduceKernelSource) + (map != NULL ? strlen( map) : 0) + 1024;
+  char *src = (char *) malloc (len);
+  char *pos = src;
+
+  if (type == REDUCE_DOUBLE)
+    pos += sprintf( pos, "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n");
+  pos += sprintf( pos, "#define T %s\n#define IDENTITY (%s)\n#define LOCAL %d\n",
+                  types[type].name, identity, REDUCE_LOCAL);
+  pos += sprintf( pos, "#define IS_SUM %d\n#define ARG %d\n",
+                  op == REDUCE_SUM, op == REDUCE_ARGMIN || op == REDUCE_ARGMAX);
+  pos += sprintf( pos, "#define BETTER(a, ia, b, ib) %s\n", better[op]);
+  pos += sprintf( pos, "#define MAP(x, y, i) (%s)\n", map != NULL ? map : "x");
+  strcpy( pos, ReduceKernelSource);
+  return src;
+}
+
+static reduce_program *getProgram( reduce_type type, reduce_op op, const char *map, cl_int *err)
+{
+  char *source = generate( type, op, map);
+  reduce_program *p;
+  size_t wg;
+
+  for (p = programs; p != NULL; p = p->next)
+    if (strcmp( p->source, source) == 0) {
+      free( source);
+      *err = CL_SUCCESS;
+      return p;
+    }
+
+  p = (reduce_program *) calloc (1, sizeof (reduce_program));
+  p->source = source;
+  p->program = clCreateProgramWithSource (context, 1, (const char **) &source, NULL, err);
+  if (*err != CL_SUCCESS) {
+    fprintf( stderr, "Error: Failed to create reduction program (%d)!\n", *err);
+    p->program = NULL;
+  } else if ((*err = clBuildProgram (p->program, 1, &device, NULL, NULL, NULL)) != CL_SUCCESS) {
+    char buffer[2048];
+
+    clGetProgramBuildInfo (p->program, device, CL_PROGRAM_BUILD_LOG,
+                           sizeof (buffer), buffer, NULL);
+    fprintf( stderr, "Error: Failed to build reduction kernel!\n%s\n%s\n", source, buffer);
+  } else {
+    p->first = clCreateKernel (p->program, "reduceFirst", err);
+    if (*err == CL_SUCCESS)
+      p->pass = clCreateKernel (p->program, "reducePass", err);
+    if (*err != CL_SUCCESS)
+      fprintf( stderr, "Error: Failed to create reduction kernels (%d)!\n", *err);
+  }
+  /* only working programs are cached */
+  if (*err != CL_SUCCESS) {
+    if (p->first != NULL)
+      clReleaseKernel (p->first);
+    if (p->program != NULL)
+      clReleaseProgram (p->program);
+    free( p->source);
+    free( p);
+    return NULL;
+  }
+
+  p->local = REDUCE_LOCAL;
+  if (clGetKernelWorkGroupInfo (p->first, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                sizeof (wg), &wg, NULL) == CL_SUCCESS && wg < p->local)
+    p->local = wg;
+  if (clGetKernelWorkGroupInfo (p->pass, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                sizeof (wg), &wg, NULL) == CL_SUCCESS && wg < p->local)
+    p->local = wg;
+
+  p->next = programs;
+  programs = p;
+  return p;
+}
+
+static cl_int ensureScratch( size_t groups)
+{
+  cl_int err = CL_SUCCESS;
+
+  if (groups <= scratch_groups)
+    return CL_SUCCESS;
+  for (int k = 0; k < 2; k++) {
+    if (scratch_val[k] != NULL)
+      clReleaseMemObject (scratch_val[k]);
+    if (scratch_idx[k] != NULL)
+      clReleaseMemObject (scratch_idx[k]);
+    /* large enough for every type */
+    scratch_val[k] = clCreateBuffer (context, CL_MEM_READ_WRITE, groups * sizeof (cl_double), NULL, &err);
+    scratch_idx[k] = clCreateBuffer (context, CL_MEM_READ_WRITE, groups * sizeof (cl_ulong), NULL, &err);
+  }
+  scratch_groups = (err == CL_SUCCESS ? groups : 0);
+  return err;
+}
+
+cl_int reduce( reduce_type type, reduce_op op, const char *map,
+               cl_mem x, cl_mem y, size_t n, void *result, cl_ulong *index)
+{
+  int arg = (op == REDUCE_ARGMIN || op == REDUCE_ARGMAX);
+  cl_ulong len = n;
+  size_t groups, global, local;
+  reduce_program *p;
+  int cur = 0;
+  cl_int err;
+
+  if (n == 0)
+    return CL_INVALID_VALUE;
+  p = getProgram( type, op, map, &err);
+  if (p == NULL)
+    return err;
+  local = p->local;
+
+  /* first stage: map and grid-stride reduce into one value per group */
+  groups = (n + local - 1) / local;
+  if (groups > compute_units * REDUCE_GROUPS_PER_UNIT)
+    groups = compute_units * REDUCE_GROUPS_PER_UNIT;
+  if ((err = ensureScratch( groups)) != CL_SUCCESS)
+    return err;
+  if (y == NULL)
+    y = x;
+  err = clSetKernelArg (p->first, 0, sizeof (cl_mem), &x);
+  err |= clSetKernelArg (p->first, 1, sizeof (cl_mem), &y);
+  err |= clSetKernelArg (p->first, 2, sizeof (cl_ulong), &len);
+  err |= clSetKernelArg (p->first, 3, sizeof (cl_mem), &scratch_val[cur]);
+  err |= clSetKernelArg (p->first, 4, sizeof (cl_mem), &scratch_idx[cur]);
+  if (err != CL_SUCCESS)
+    return err;
+  global = groups * local;
+  err = clEnqueueNDRangeKernel (queue, p->first, 1, NULL, &global, &local, 0, NULL, NULL);
+  if (err != CL_SUCCESS)
+    return err;
+
+  /* further stages: each work-item combines up to 8 values before the
+   * tree, so every pass shrinks the count by 8*local */
+  while (groups > 1) {
+    len = groups;
+    groups = (groups + 8*local - 1) / (8*local);
+    err = clSetKernelArg (p->pass, 0, sizeof (cl_mem), &scratch_val[cur]);
+    err |= clSetKernelArg (p->pass, 1, sizeof (cl_mem), &scratch_idx[cur]);
+    err |= clSetKernelArg (p->pass, 2, sizeof (cl_ulong), &len);
+    err |= clSetKernelArg (p->pass, 3, sizeof (cl_mem), &scratch_val[1-cur]);
+    err |= clSetKernelArg (p->pass, 4, sizeof (cl_mem), &scratch_idx[1-cur]);
+    if (err != CL_SUCCESS)
+      return err;
+    global = groups * local;
+    err = clEnqueueNDRangeKernel (queue, p->pass, 1, NULL, &global, &local, 0, NULL, NULL);
+    if (err != CL_SUCCESS)
+      return err;
+    cur = 1 - cur;
+  }
+
+  err = clEnqueueReadBuffer (queue, scratch_val[cur], CL_TRUE, 0, types[type].size, result, 0, NULL, NULL);
+  if (err == CL_SUCCESS && arg && index != NULL)
+    err = clEnqueueReadBuffer (queue, scratch_idx[cur], CL_TRUE, 0, sizeof (cl_ulong), index, 0, NULL, NULL);
+  return err;
+}
+
+void reduceRelease( void)
+{
+  while (programs != NULL) {
+    reduce_program *p = programs;
+
+    programs = p->next;
+    clReleaseKernel (p->first);
+    clReleaseKernel (p->pass);
+    clReleaseProgram (p->program);
+    free( p->source);
+    free( p);
+  }
+  for (int k = 0; k < 2; k++) {
+    if (scratch_val[k] != NULL)
+      clReleaseMemObject (scratch_val[k]);
+    if (scratch_idx[k] != NULL)
+      clReleaseMemObject (scratch_idx[k]);
+    scratch_val[k] = scratch_idx[k] = NULL;
+  }
+  scratch_groups = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+/* Reductions of device buffers to one value, of which only the value
+ * (and for argmin/argmax its index) is read back.
+ *
+ * An optional element-wise map is fused into the first stage: it is an
+ * OpenCL C expression of x (element i of the first buffer), y (element i
+ * of the second buffer, if given) and i, e.g. "x*y" for a dot product or
+ * "fabs(x-y)" with REDUCE_MAX for a maximum error. The first stage runs a
+ * grid-stride loop over a few work-groups per compute unit, further
+ * stages reduce the per-group results by tree reductions in local memory
+ * until one is left, so any length works. Programs are specialised by
+ * type, operator and map through #defines and cached.
+ *
+ *   double dot;
+ *   err = reduce( REDUCE_DOUBLE, REDUCE_SUM, "x*y", d_a, d_b, n, &dot, NULL);
+ */
+
+typedef enum { REDUCE_FLOAT, REDUCE_DOUBLE, REDUCE_INT, REDUCE_LONG } reduce_type;
+
+/* argmin/argmax return the smallest index of the extreme value */
+typedef enum { REDUCE_SUM, REDUCE_MIN, REDUCE_MAX, REDUCE_ARGMIN, REDUCE_ARGMAX } reduce_op;
+
+void reduceSetDevice( cl_context context, cl_device_id device, cl_command_queue queue);
+
+/* Reduces map(x[i], y[i], i) for 0 <= i < n; map NULL means x, y may be
+ * NULL. result receives a float, double, cl_int or cl_long according to
+ * type, index (if not NULL) the index for REDUCE_ARGMIN/ARGMAX. Blocks
+ * until the result is on the host. Returns CL_INVALID_VALUE for n == 0.  */
+cl_int reduce( reduce_type type, reduce_op op, const char *map,
+               cl_mem x, cl_mem y, size_t n, void *result, cl_ulong *index);
+
+/* releases the cached programs */
+void reduceRelease( void);
+
+#endif
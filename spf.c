@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "spf.h"
+
+static void sieve( uint32_t *spf, long limit)
+{
+  long count = limit / 2 + 1;
+  uint32_t *primes = (uint32_t *) malloc (count / 2 * sizeof (uint32_t) + 16);
+  long nprimes = 0;
+
+  memset( spf, 0, count * sizeof (uint32_t));
+  spf[0] = 1;
+  for (long i = 3; i <= limit; i += 2) {
+    if (spf[i/2] == 0) {
+      spf[i/2] = (uint32_t) i;
+      primes[nprimes++] = (uint32_t) i;
+    }
+    /* i*p is struck by p, its smallest prime, and by no other i */
+    for (long k = 0; k < nprimes && primes[k] <= spf[i/2]; k++) {
+      long m = i * (long) primes[k];
+
+      if (m > limit)
+        break;
+      spf[m/2] = primes[k];
+    }
+  }
+  free( primes);
+}
+
+int spfCreate( long limit, const char *path, spf_table *t)
+{
+  size_t count;
+
+  memset( t, 0, sizeof (spf_table));
+  if (limit < 1 || limit > 0xffffffffL) {
+    errno = EINVAL;
+    return -1;
+  }
+  /* the last entry is an odd n */
+  limit |= 1;
+  count = limit / 2 + 1;
+
+  if (path == NULL) {
+    t->spf = (uint32_t *) malloc (count * sizeof (uint32_t));
+    if (t->spf == NULL)
+      return -1;
+  } else {
+    if (binioCreate( path, BINIO_UINT32, 1, &count, 0, &t->file) != 0)
+      return -1;
+    t->spf = (uint32_t *) t->file.data;
+    t->mapped = 1;
+  }
+  t->limit = limit;
+  sieve( t->spf, limit);
+  if (t->mapped)
+    binioSync( &t->file);
+  return 0;
+}
+
+int spfOpen( const char *path, spf_table *t)
+{
+  memset( t, 0, sizeof (spf_table));
+  if (binioOpen( path, 0, &t->file) != 0)
+    return -1;
+  if (t->file.hdr.dtype != BINIO_UINT32 || t->file.hdr.ndims != 1
+      || !binioIsDense( &t->file) || t->file.hdr.dims[0] < 1) {
+    binioClose( &t->file);
+    errno = EINVAL;
+    return -1;
+  }
+  t->spf = (uint32_t *) t->file.data;
+  t->limit = 2 * (long) t->file.hdr.dims[0] - 1;
+  t->mapped = 1;
+  /* point queries hit the table at random */
+  binioAdvise( &t->file, 0, 0, BINIO_RANDOM);
+  return 0;
+}
+
+long spfEuler( const spf_table *t, long n)
+{
+  long phi;
+  int twos;
+
+  if (n < 2)
+    return 0;
+  if (n > t->limit)
+    return -1;
+  twos = __builtin_ctzl( n);
+  phi = (twos > 0 ? 1L << (twos - 1) : 1);
+  n >>= twos;
+  while (n > 1) {
+    long p = t->spf[n/2];
+
+    n /= p;
+    phi *= p - 1;
+    while (t->spf[n/2] == p && n > 1) {
+      n /= p;
+      phi *= p;
+    }
+  }
+  return phi;
+}
+
+void spfClose( spf_table *t)
+{
+  if (t->mapped)
+    binioClose( &t->file);
+  else
+    free( t->spf);
+  memset( t, 0, sizeof (spf_table));
+}
@@ -0,0 +1,46 @@
+#ifndef SPF_H
+#define SPF_H
+
+#include <stdint.h>
+
+#include "binio.h"
+
+/* Smallest-prime-factor table for O(log n) totients.
+ *
+ * Built once by a linear sieve (every composite is struck exactly once,
+ * by its smallest prime) over the odd numbers only: the factor 2 of n is
+ * taken off by its trailing zero count, so the table holds spf(n) for odd
+ * n at index n/2, 4 bytes per two numbers. phi(n) then follows from the
+ * factorisation, one table lookup and one division per prime factor.
+ *
+ * With a path the table lives in a binio file (dtype BINIO_UINT32, one
+ * dimension) and later runs map it instead of sieving again; only the
+ * pages the queries touch are read.
+ *
+ *   spf_table t;
+ *   if (spfOpen( "spf.bin", &t) != 0 || t.limit < n)
+ *     spfCreate( n, "spf.bin", &t);
+ *   phi = spfEuler( &t, n);
+ *   spfClose( &t);
+ */
+
+typedef struct {
+  long limit;                   /* largest n covered */
+  uint32_t *spf;                /* spf[n/2] for odd n; spf[0] = 1 */
+  binio_array file;             /* when backed by a file */
+  int mapped;
+} spf_table;
+
+/* Sieves the table up to limit (< 2^32, rounded up to odd), in memory for
+ * a NULL path, otherwise into a new file at path. Returns 0 or -1.  */
+int spfCreate( long limit, const char *path, spf_table *t);
+
+/* maps a table written by spfCreate; -1 if path is missing or not one */
+int spfOpen( const char *path, spf_table *t);
+
+/* euler(n) as in trsequential.c (0 for n < 2); -1 above the limit */
+long spfEuler( const spf_table *t, long n);
+
+void spfClose( spf_table *t);
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #ifdef OSX
@@ -10,16 +11,33 @@
 
 #include "timer.h"
 #include "simple.h"
+#include "philox.h"
+#include "vload.h"
 
 #define DATA_SIZE 10240000
+#define SEED 42
+
+/* Each work-item squares W elements at a time with vloadn/vstoren, W the
+ * device's preferred float vector width (see vload.h), and strides over
+ * the data, so at most GROUPS work-groups are launched for any count.
+ * main() puts "#define W n" in front of the source.  */
+#ifndef GROUPS
+#define GROUPS 256
+#endif
 
-const char *KernelSource =                 "\n"
+const char *KernelSource = VLOAD_SOURCE
   "__kernel void square(                    \n"
   "   __global float* input,                \n"
   "   __global float* output,               \n"
   "   const unsigned int count)             \n"
   "{                                        \n"
-  "   int i = get_global_id(0);             \n"
+  "   size_t stride = get_global_size(0);   \n"
+  "   size_t nv = count / W;                \n"
+  "   size_t i;                             \n"
+  "   for(i = get_global_id(0); i < nv; i += stride) {\n"
+  "     VSTORE(VLOAD(i, input) * VLOAD(i, input), i, output);\n"
+  "   }                                     \n"
+  "   for(i = nv*W + get_global_id(0); i < count; i += stride)\n"
   "     output[i] = input[i] * input[i];    \n"
   "}                                        \n"
   "\n";
@@ -46,6 +64,22 @@ void timeDirectImplementation( int count, float* data, float* results)
   printTimeElapsed( "kernel equivalent on host");
 }
 
+/* W for the kernel, from the first device of the given type; that is the
+ * device initDevice() in simple.c picks.  */
+cl_uint deviceWidth( cl_device_type type)
+{
+  cl_platform_id platforms[16];
+  cl_device_id device;
+  cl_uint num_platforms;
+
+  if (clGetPlatformIDs (16, platforms, &num_platforms) != CL_SUCCESS)
+    return 1;
+  for (cl_uint i = 0; i < num_platforms && i < 16; i++)
+    if (clGetDeviceIDs (platforms[i], type, 1, &device, NULL) == CL_SUCCESS)
+      return vloadWidth( device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT);
+  return 1;
+}
+
 
 int main (int argc, char * argv[])
 {
@@ -69,14 +103,15 @@ int main (int argc, char * argv[])
   int correct;                       /* Number of correct results returned.  */
 
   int count = DATA_SIZE;
-  global[0] = count;
+  cl_device_type type;
+  cl_uint width;
+  char *source;
 
   data = (float *) malloc (count * sizeof (float));
   results = (float *) malloc (count * sizeof (float));
 
   /* Fill the vector with random float values.  */
-  for (int i = 0; i < count; i++)
-    data[i] = rand () / (float) RAND_MAX;
+  philoxUniform( SEED, 0, data, count);
 
 
   TIMERwc_time( &startsec, &startnsec);
@@ -84,13 +119,26 @@ int main (int argc, char * argv[])
   if( argc > 2) {
     printf( "using openCL on host!\n");
     err = initCPU();
+    type = CL_DEVICE_TYPE_CPU;
   } else  {
     printf( "using openCL on GPU!\n");
     err = initGPU();
+    type = CL_DEVICE_TYPE_GPU;
   }
   
   if( err == CL_SUCCESS) {
-    kernel = setupKernel( KernelSource, "square", 3, FloatArr, count, data,
+    width = deviceWidth( type);
+    printf( "vector width: %u\n", width);
+    global[0] = (count / width + local[0] - 1) / local[0];
+    if (global[0] > GROUPS)
+      global[0] = GROUPS;
+    if (global[0] == 0)
+      global[0] = 1;
+    global[0] *= local[0];
+
+    source = (char *) malloc (strlen (KernelSource) + 32);
+    sprintf( source, "#define W %u\n%s", width, KernelSource);
+    kernel = setupKernel( source, "square", 3, FloatArr, count, data,
                                                      FloatArr, count, results,
                                                      IntConst, count);
 
@@ -116,6 +164,7 @@ int main (int argc, char * argv[])
 
     err = clReleaseKernel (kernel);
     err = freeDevice();
+    free( source);
 
     timeDirectImplementation( count, data, results);
     
@@ -3,17 +3,30 @@
 
 #include <CL/cl.h>
 
+#include "philox.h"
+#include "vload.h"
+
 #define DATA_SIZE 1024
+#define SEED 42
+#define GROUPS_PER_UNIT 8
 
-const char *KernelSource =                   "\n"
+/* Built with -DW=n, n the device's preferred float vector width (see
+ * vload.h): each work-item strides over the data W elements at a time,
+ * so a few work-groups per compute unit cover any count.  */
+const char *KernelSource = VLOAD_SOURCE
   "__kernel void square(                    \n"
   "   __global float* input,                \n"
   "   __global float* output,               \n"
   "   const unsigned int count)             \n"
   "{                                        \n"
-  "   int i = get_global_id(0);             \n"
-  "   if(i < count)                         \n"
-  "       output[i] = input[i] * input[i];  \n"
+  "   size_t stride = get_global_size(0);   \n"
+  "   size_t nv = count / W;                \n"
+  "   size_t i;                             \n"
+  "   for(i = get_global_id(0); i < nv; i += stride) {\n"
+  "     VSTORE(VLOAD(i, input) * VLOAD(i, input), i, output);\n"
+  "   }                                     \n"
+  "   for(i = nv*W + get_global_id(0); i < count; i += stride)\n"
+  "     output[i] = input[i] * input[i];    \n"
   "}                                        \n"
   "\n";
 
@@ -38,6 +51,9 @@ main (int argc, char *argv[])
   cl_command_queue commands;        /* Compute command queue.  */
   cl_program program;                /* Compute program.  */
   cl_kernel kernel;                /* Compute kernel.  */
+  cl_uint width = 1;                /* Float vector width of the kernel.  */
+  cl_uint units = 1;                /* Compute units of the device.  */
+  char options[32];
 
   /* Create data for the run.  */
   float *data = NULL;                /* Original data set given to device.  */
@@ -75,6 +91,11 @@ main (int argc, char *argv[])
   if (!commands || err != CL_SUCCESS)
     die ("Error: Failed to create a command commands!");
 
+  width = vloadWidth (device_id, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT);
+  clGetDeviceInfo (device_id, CL_DEVICE_MAX_COMPUTE_UNITS,
+                   sizeof (cl_uint), &units, NULL);
+  sprintf (options, "-DW=%u", width);
+
   /* Create the compute program from the source buffer.  */
   program = clCreateProgramWithSource (context, 1,
                                        (const char **) &KernelSource,
@@ -83,7 +104,7 @@ main (int argc, char *argv[])
     die ("Error: Failed to create compute program!");
 
   /* Build the program executable.  */
-  err = clBuildProgram (program, 0, NULL, NULL, NULL, NULL);
+  err = clBuildProgram (program, 0, NULL, options, NULL, NULL);
   if (err != CL_SUCCESS)
     {
       size_t len;
@@ -102,24 +123,21 @@ main (int argc, char *argv[])
   data = (float *) malloc (DATA_SIZE * sizeof (float));
   results = (float *) malloc (DATA_SIZE * sizeof (float));
 
-  /* Fill the vector with random float values.  */
-  for (unsigned i = 0; i < count; i++)
-    data[i] = rand () / (float) RAND_MAX;
+  /* The same random values the device generates, for validation only.  */
+  philoxUniform (SEED, 0, data, count);
 
-  /* Create the device memory vectors.  */
-  input = clCreateBuffer (context, CL_MEM_READ_ONLY,
+  /* Create the device memory vectors; the generator kernel writes input.  */
+  input = clCreateBuffer (context, CL_MEM_READ_WRITE,
                           sizeof (float) * count, NULL, NULL);
   output = clCreateBuffer (context, CL_MEM_WRITE_ONLY,
                            sizeof (float) * count, NULL, NULL);
   if (!input || !output)
     die ("Error: Failed to allocate device memory!");
 
-  /* Transfer the input vector into device memory.  */
-  if (CL_SUCCESS
-      != clEnqueueWriteBuffer (commands, input,
-                               CL_TRUE, 0, sizeof (float) * count,
-                               data, 0, NULL, NULL))
-    die ("Error: Failed to write to source array!");
+  /* Generate the input vector in device memory, nothing is uploaded.  */
+  philoxSetDevice (context, device_id, commands);
+  if (CL_SUCCESS != philoxUniformDevice (input, SEED, 0, count))
+    die ("Error: Failed to generate source array!");
 
   /* Set the arguments to the compute kernel.  */
   err = 0;
@@ -136,9 +154,14 @@ main (int argc, char *argv[])
                                    sizeof (local), &local, NULL))
     die ("Error: Failed to retrieve kernel work group info!");
 
-  /* Execute the kernel over the vector using the
- *      maximum number of work group items for this device.  */
-  global = count;
+  /* Execute the kernel with work groups of the maximum size for this
+ *      device, a few per compute unit, no more than the vectors need.  */
+  global = (count / width + local - 1) / local;
+  if (global > units * GROUPS_PER_UNIT)
+    global = units * GROUPS_PER_UNIT;
+  if (global == 0)
+    global = 1;
+  global *= local;
   if (CL_SUCCESS
       != clEnqueueNDRangeKernel (commands, kernel,
                                  1, NULL, &global, &local, 0, NULL, NULL))
@@ -164,6 +187,7 @@ main (int argc, char *argv[])
   printf ("Computed %d/%d %2.0f%% correct values\n", correct, count,
           (float)count/correct*100.f);
 
+  philoxRelease ();
   clReleaseMemObject (input);
   clReleaseMemObject (output);
   clReleaseProgram (program);
@@ -14,9 +14,13 @@ Sources: http://www.eriksmistad.no/getting-started-with-opencl-and-gpu-computing
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "vload.h"
 
 
 #define MAX_SOURCE_SIZE (0x100000)
+#define GROUPS_PER_UNIT 8
 
 
 
@@ -66,6 +70,13 @@ int main(int argc, char ** argv) {
 	cl_int ret = clGetPlatformIDs(1, &platformId, &retNumPlatforms);
 	ret = clGetDeviceIDs(platformId, CL_DEVICE_TYPE_DEFAULT, 1, &deviceID, &retNumDevices);
 
+	// Vector width of the kernel
+	cl_uint width, computeUnits = 1;
+	char options[32];
+	width = vloadWidth(deviceID, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT);
+	clGetDeviceInfo(deviceID, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+	sprintf(options, "-DW=%u", width);
+
 	// Creating context.
 	cl_context context = clCreateContext(NULL, 1, &deviceID, NULL, NULL,  &ret);
 
@@ -83,11 +94,13 @@ int main(int argc, char ** argv) {
 	ret = clEnqueueWriteBuffer(commandQueue, aMemObj, CL_TRUE, 0, SIZE * sizeof(float), A, 0, NULL, NULL);;
 	ret = clEnqueueWriteBuffer(commandQueue, bMemObj, CL_TRUE, 0, SIZE * sizeof(float), B, 0, NULL, NULL);
 
-	// Create program from kernel source
-	cl_program program = clCreateProgramWithSource(context, 1, (const char **)&kernelSource, (const size_t *)&kernelSize, &ret);
+	// Create program from the VLOAD/VSTORE macros and the kernel source
+	const char *sources[2] = { VLOAD_SOURCE, kernelSource };
+	size_t sizes[2] = { strlen(VLOAD_SOURCE), kernelSize };
+	cl_program program = clCreateProgramWithSource(context, 2, sources, sizes, &ret);
 
 	// Build program
-	ret = clBuildProgram(program, 1, &deviceID, NULL, NULL, NULL);
+	ret = clBuildProgram(program, 1, &deviceID, options, NULL, NULL);
 
 	// Create kernel
 	cl_kernel kernel = clCreateKernel(program, "addVectors", &ret);
@@ -97,11 +110,20 @@ int main(int argc, char ** argv) {
 	ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&aMemObj);
 	ret = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&bMemObj);
 	ret = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&cMemObj);
+	cl_uint n = SIZE;
+	ret = clSetKernelArg(kernel, 3, sizeof(cl_uint), (void *)&n);
 
 
 	// Execute the kernel
-	size_t globalItemSize = SIZE;
-	size_t localItemSize = 64; // globalItemSize has to be a multiple of localItemSize. 1024/64 = 16
+	// A few work-groups per compute unit, each work-item strides over
+	// the arrays W elements at a time
+	size_t localItemSize = 64;
+	size_t groups = (SIZE / width + localItemSize - 1) / localItemSize;
+	if (groups > computeUnits * GROUPS_PER_UNIT)
+		groups = computeUnits * GROUPS_PER_UNIT;
+	if (groups == 0)
+		groups = 1;
+	size_t globalItemSize = groups * localItemSize;
 	ret = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, &globalItemSize, &localItemSize, 0, NULL, NULL);
 
 	// Read from device back to host.
@@ -1,5 +1,10 @@
 /*
 Sources: http://www.eriksmistad.no/getting-started-with-opencl-and-gpu-computing/
+
+Sum of the totients between lower and upper with trKernel.cl, checked
+against the segmented sieve on the host.
+
+usage: test_opencl2 lower upper [cpu]
 */
 
 // openCL headers
@@ -14,32 +19,45 @@ Sources: http://www.eriksmistad.no/getting-started-with-opencl-and-gpu-computing
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+
+#include "totient.h"
 
 
 #define MAX_SOURCE_SIZE (0x100000)
+#define GROUPS_PER_UNIT 16
 
 
 
 int main(int argc, char ** argv) {
 
-	int SIZE = 1024;
-
-	// Allocate memories for input arrays and output array.
-	float *A = (float*)malloc(sizeof(float)*SIZE);
-	float *B = (float*)malloc(sizeof(float)*SIZE);
-
-	// Output
-	float *C = (float*)malloc(sizeof(float)*SIZE);
+	long lower, upper;
+	int i;
 
+	if (argc < 3) {
+		printf("usage: test_opencl2 lower upper [cpu]\n");
+		return 1;
+	}
+	sscanf(argv[1], "%ld", &lower);
+	sscanf(argv[2], "%ld", &upper);
+	if (lower < 0)
+		lower = 0;
+	if (upper < lower) {
+		printf("upper must not be below lower\n");
+		return 1;
+	}
 
-	// Initialize values for array members.
-	int i = 0;
-	for (i=0; i<SIZE; ++i) {
-		A[i] = i+1;
-		B[i] = (i+1)*2;
+	// Primes up to sqrt(upper) for the trial divisions
+	long nprimes;
+	long *primes = totientPrimes((long) sqrtl((long double) upper) + 1, &nprimes);
+	cl_uint *P = (cl_uint*)malloc(sizeof(cl_uint)*(nprimes+1));
+	for (i=0; i<nprimes; ++i) {
+		P[i] = (cl_uint) primes[i];
 	}
+	free(primes);
 
-	// Load kernel from file vecAddKernel.cl
+	// Load kernel from file trKernel.cl
 
 	FILE *kernelFile;
 	char *kernelSource;
@@ -63,8 +81,14 @@ int main(int argc, char ** argv) {
 	cl_device_id deviceID = NULL;
 	cl_uint retNumDevices;
 	cl_uint retNumPlatforms;
+	cl_uint computeUnits = 1;
 	cl_int ret = clGetPlatformIDs(1, &platformId, &retNumPlatforms);
-	ret = clGetDeviceIDs(platformId, CL_DEVICE_TYPE_DEFAULT, 1, &deviceID, &retNumDevices);
+	ret = clGetDeviceIDs(platformId, argc > 3 ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_DEFAULT, 1, &deviceID, &retNumDevices);
+	if (ret != CL_SUCCESS) {
+		fprintf(stderr, "Failed to find a device\n");
+		return 1;
+	}
+	clGetDeviceInfo(deviceID, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
 
 	// Creating context.
 	cl_context context = clCreateContext(NULL, 1, &deviceID, NULL, NULL,  &ret);
@@ -73,56 +97,76 @@ int main(int argc, char ** argv) {
 	// Creating command queue
 	cl_command_queue commandQueue = clCreateCommandQueue(context, deviceID, 0, &ret);
 
-	// Memory buffers for each array
-	cl_mem aMemObj = clCreateBuffer(context, CL_MEM_READ_ONLY, SIZE * sizeof(float), NULL, &ret);
-	cl_mem bMemObj = clCreateBuffer(context, CL_MEM_READ_ONLY, SIZE * sizeof(float), NULL, &ret);
-	cl_mem cMemObj = clCreateBuffer(context, CL_MEM_WRITE_ONLY, SIZE * sizeof(float), NULL, &ret);
-
-
-	// Copy lists to memory buffers
-	ret = clEnqueueWriteBuffer(commandQueue, aMemObj, CL_TRUE, 0, SIZE * sizeof(float), A, 0, NULL, NULL);;
-	ret = clEnqueueWriteBuffer(commandQueue, bMemObj, CL_TRUE, 0, SIZE * sizeof(float), B, 0, NULL, NULL);
-
 	// Create program from kernel source
 	cl_program program = clCreateProgramWithSource(context, 1, (const char **)&kernelSource, (const size_t *)&kernelSize, &ret);
 
 	// Build program
 	ret = clBuildProgram(program, 1, &deviceID, NULL, NULL, NULL);
+	if (ret != CL_SUCCESS) {
+		char buffer[2048];
+
+		clGetProgramBuildInfo(program, deviceID, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, NULL);
+		fprintf(stderr, "Failed to build trKernel.cl\n%s\n", buffer);
+		return 1;
+	}
 
 	// Create kernel
 	cl_kernel kernel = clCreateKernel(program, "calculateTR", &ret);
 
+	// A few work-groups per compute unit; each work-item strides over
+	// the range, so any [lower, upper] fits the same launch
+	size_t localItemSize = 64;
+	size_t maxLocal;
+	clGetKernelWorkGroupInfo(kernel, deviceID, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxLocal, NULL);
+	if (localItemSize > maxLocal)
+		localItemSize = maxLocal;
+	size_t groups = computeUnits * GROUPS_PER_UNIT;
+	if (groups > (upper - lower) / localItemSize + 1)
+		groups = (upper - lower) / localItemSize + 1;
+	size_t globalItemSize = groups * localItemSize;
+
+	// Memory buffers for the primes and the per-group sums
+	cl_mem primesMemObj = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (nprimes+1) * sizeof(cl_uint), P, &ret);
+	cl_mem sumsMemObj = clCreateBuffer(context, CL_MEM_WRITE_ONLY, groups * sizeof(cl_ulong), NULL, &ret);
+	cl_ulong *sums = (cl_ulong*)malloc(groups * sizeof(cl_ulong));
 
 	// Set arguments for kernel
-	ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&aMemObj);
-	ret = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&bMemObj);
-	ret = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&cMemObj);
+	cl_ulong lo = lower, hi = upper;
+	cl_uint np = nprimes;
+	ret = clSetKernelArg(kernel, 0, sizeof(cl_ulong), (void *)&lo);
+	ret |= clSetKernelArg(kernel, 1, sizeof(cl_ulong), (void *)&hi);
+	ret |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&primesMemObj);
+	ret |= clSetKernelArg(kernel, 3, sizeof(cl_uint), (void *)&np);
+	ret |= clSetKernelArg(kernel, 4, sizeof(cl_mem), (void *)&sumsMemObj);
+	ret |= clSetKernelArg(kernel, 5, localItemSize * sizeof(cl_ulong), NULL);
 
 
 	// Execute the kernel
-	size_t globalItemSize = SIZE;
-	size_t localItemSize = 64; // globalItemSize has to be a multiple of localItemSize. 1024/64 = 16
-	ret = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, &globalItemSize, &localItemSize, 0, NULL, NULL);
+	double start = omp_get_wtime();
+	ret |= clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, &globalItemSize, &localItemSize, 0, NULL, NULL);
 
 	// Read from device back to host.
-	ret = clEnqueueReadBuffer(commandQueue, cMemObj, CL_TRUE, 0, SIZE * sizeof(float), C, 0, NULL, NULL);
+	ret |= clEnqueueReadBuffer(commandQueue, sumsMemObj, CL_TRUE, 0, groups * sizeof(cl_ulong), sums, 0, NULL, NULL);
+	double stop = omp_get_wtime();
+	if (ret != CL_SUCCESS) {
+		fprintf(stderr, "Failed to run calculateTR (%d)\n", ret);
+		return 1;
+	}
 
-	// Write result
-	
-	for (i=0; i<SIZE; ++i) {
-		printf("%f + %f = %f\n", A[i], B[i], C[i]);
+	// Add up the partial sums, 128 bit
+	__int128 sum = 0;
+	char digits[48];
+	for (i=0; i<(int)groups; ++i) {
+		sum += sums[i];
 	}
-	
+	printf("C: Sum of Totients  between [%ld..%ld] is %s\n", lower, upper, totientFormat(sum, digits));
+	printf("Device time: %f s (%lu work-groups of %lu)\n", stop - start, (unsigned long)groups, (unsigned long)localItemSize);
 
 	// Test if correct answer
-	for (i=0; i<SIZE; ++i) {
-		if (C[i] != (A[i] + B[i])) {
-			printf("Something didn't work correctly! Failed test. \n");
-			break;
-		}
-	}
-	if (i == SIZE) {
+	if (sum == totientSieveSum(lower, upper)) {
 		printf("Everything seems to work fine! \n");
+	} else {
+		printf("Something didn't work correctly! Failed test. \n");
 	}
 
 	// Clean up, release memory.
@@ -131,13 +175,12 @@ int main(int argc, char ** argv) {
 	ret = clReleaseCommandQueue(commandQueue);
 	ret = clReleaseKernel(kernel);
 	ret = clReleaseProgram(program);
-	ret = clReleaseMemObject(aMemObj);
-	ret = clReleaseMemObject(bMemObj);
-	ret = clReleaseMemObject(cMemObj);
+	ret = clReleaseMemObject(primesMemObj);
+	ret = clReleaseMemObject(sumsMemObj);
 	ret = clReleaseContext(context);
-	free(A);
-	free(B);
-	free(C);
+	free(P);
+	free(sums);
+	free(kernelSource);
 
 	return 0;
 
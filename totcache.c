@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "totcache.h"
+#include "totient.h"
+
+#define TOTCACHE_MIN_ROWS 64
+
+static int64_t *row( totcache *c, long k)
+{
+  return (int64_t *) c->file.data + 2 * k;
+}
+
+static __int128 checkpoint( totcache *c, long k)
+{
+  int64_t *r;
+
+  if (k == 0)
+    return 0;
+  r = row( c, k);
+  return ((__int128) r[1] << 64) | (uint64_t) r[0];
+}
+
+/* a new file with room for rows, holding the first count rows of c */
+static int createFile( totcache *c, long rows)
+{
+  size_t dims[2] = { (size_t) rows, 2 };
+  size_t len = strlen( c->path);
+  char *tmp = (char *) malloc (len + 5);
+  binio_array file;
+
+  sprintf( tmp, "%s.new", c->path);
+  if (binioCreate( tmp, BINIO_INT64, 2, dims, 0, &file) != 0) {
+    free( tmp);
+    return -1;
+  }
+  if (c->file.data != NULL)
+    memcpy( file.data, c->file.data, (c->count + 1) * 2 * sizeof (int64_t));
+  ((int64_t *) file.data)[0] = c->block;
+  ((int64_t *) file.data)[1] = c->count;
+  if (binioSync( &file) != 0 || rename( tmp, c->path) != 0) {
+    binioClose( &file);
+    unlink( tmp);
+    free( tmp);
+    return -1;
+  }
+  free( tmp);
+  if (c->file.data != NULL)
+    binioClose( &c->file);
+  c->file = file;
+  c->capacity = rows - 1;
+  return 0;
+}
+
+int totcacheOpen( const char *path, long block, totcache *c)
+{
+  memset( c, 0, sizeof (totcache));
+  c->path = strdup( path);
+
+  if (binioOpen( path, 1, &c->file) == 0) {
+    if (c->file.hdr.dtype != BINIO_INT64 || c->file.hdr.ndims != 2
+        || c->file.hdr.dims[1] != 2 || c->file.hdr.dims[0] < 1 || !binioIsDense( &c->file)) {
+      binioClose( &c->file);
+      free( c->path);
+      errno = EINVAL;
+      return -1;
+    }
+    c->block = row( c, 0)[0];
+    c->count = row( c, 0)[1];
+    c->capacity = (long) c->file.hdr.dims[0] - 1;
+    if (c->block < 1 || c->count < 0 || c->count > c->capacity) {
+      binioClose( &c->file);
+      free( c->path);
+      errno = EINVAL;
+      return -1;
+    }
+    return 0;
+  }
+  if (errno != ENOENT) {
+    free( c->path);
+    return -1;
+  }
+
+  c->block = (block > 0 ? block : TOTCACHE_BLOCK);
+  c->file.data = NULL;
+  if (createFile( c, TOTCACHE_MIN_ROWS) != 0) {
+    free( c->path);
+    return -1;
+  }
+  return 0;
+}
+
+/* appends checkpoints up to k */
+static int extend( totcache *c, long k)
+{
+  if (k > c->capacity) {
+    long rows = 2 * (c->capacity + 1);
+
+    while (rows - 1 < k)
+      rows *= 2;
+    if (createFile( c, rows) != 0)
+      return -1;
+  }
+  while (c->count < k) {
+    long j = c->count + 1;
+    __int128 e = checkpoint( c, c->count)
+                 + totientSieveSum( (j - 1) * c->block + 1, j * c->block);
+    int64_t *r = row( c, j);
+
+    r[0] = (int64_t)(uint64_t) e;
+    r[1] = (int64_t)(e >> 64);
+    /* the count goes last, so an interrupted run leaves a valid cache */
+    row( c, 0)[1] = c->count = j;
+  }
+  return binioSync( &c->file);
+}
+
+__int128 totcachePrefix( totcache *c, long x)
+{
+  long k;
+
+  if (x < 2)
+    return 0;
+  k = x / c->block;
+  if (k > c->count && extend( c, k) != 0)
+    /* not kept, but the answer is still right */
+    return totientSieveSum( 2, x);
+  return checkpoint( c, k) + totientSieveSum( k * c->block + 1, x);
+}
+
+__int128 totcacheRange( totcache *c, long lower, long upper)
+{
+  if (lower < 1)
+    lower = 1;
+  if (upper < lower)
+    return 0;
+  return totcachePrefix( c, upper) - totcachePrefix( c, lower - 1);
+}
+
+void totcacheClose( totcache *c)
+{
+  if (c->file.data != NULL)
+    binioClose( &c->file);
+  free( c->path);
+  memset( c, 0, sizeof (totcache));
+}
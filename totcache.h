@@ -0,0 +1,47 @@
+#ifndef TOTCACHE_H
+#define TOTCACHE_H
+
+#include "binio.h"
+
+/* Persistent prefix sums of euler(n) for repeated range queries.
+ *
+ * The cache holds checkpoints E(k*block), E(x) = euler(1) + ... + euler(x),
+ * in a binio file (BINIO_INT64, dims {rows, 2}: row 0 is {block, count},
+ * row k the low and high word of the 128-bit E(k*block)). A query
+ * sum(lower..upper) = E(upper) - E(lower-1) reads the checkpoint below
+ * each end and sieves the rest, at most two partial blocks. A query past
+ * the frontier first extends it: the missing blocks are sieved in order,
+ * appended, and the file (grown by doubling into a new file renamed over
+ * the old one) keeps them for the next run.
+ *
+ *   totcache c;
+ *   if (totcacheOpen( "totient.cache", 0, &c) == 0) {
+ *     sum = totcacheRange( &c, lower, upper);
+ *     totcacheClose( &c);
+ *   }
+ */
+
+/* default block of a new cache */
+#define TOTCACHE_BLOCK (1L << 20)
+
+typedef struct {
+  char *path;
+  binio_array file;
+  long block;
+  long count;                   /* checkpoints k = 1..count are valid */
+  long capacity;
+} totcache;
+
+/* Maps the cache at path, creating it (block 0: TOTCACHE_BLOCK) if it is
+ * missing. An existing cache keeps its own block. Returns 0 or -1.  */
+int totcacheOpen( const char *path, long block, totcache *c);
+
+/* E(x), extending the cache if needed */
+__int128 totcachePrefix( totcache *c, long x);
+
+/* sum of euler(n) for lower <= n <= upper */
+__int128 totcacheRange( totcache *c, long lower, long upper);
+
+void totcacheClose( totcache *c);
+
+#endif
@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#include "totient.h"
+
+long *totientPrimes( long limit, long *nprimes)
+{
+  char *composite = (char *) calloc (limit + 1, 1);
+  long *primes;
+  long count = 0;
+
+  for (long p = 2; p * p <= limit; p++)
+    if (!composite[p])
+      for (long m = p * p; m <= limit; m += p)
+        composite[m] = 1;
+  for (long p = 2; p <= limit; p++)
+    count += !composite[p];
+
+  primes = (long *) malloc ((count + 1) * sizeof (long));
+  count = 0;
+  for (long p = 2; p <= limit; p++)
+    if (!composite[p])
+      primes[count++] = p;
+
+  free( composite);
+  *nprimes = count;
+  return primes;
+}
+
+void totientSieveSegment( long lo, long hi, const long *primes, long nprimes,
+                          unsigned long *phi, unsigned long *prod)
+{
+  long len = hi - lo;
+
+  for (long k = 0; k < len; k++) {
+    phi[k] = 1;
+    prod[k] = 1;
+  }
+  for (long i = 0; i < nprimes; i++) {
+    unsigned long p = primes[i];
+    unsigned long pk;
+
+    if (p * p > (unsigned long)(hi - 1))
+      break;
+    for (long m = (lo + p - 1) / p * p; m < hi; m += p) {
+      phi[m - lo] *= p - 1;
+      prod[m - lo] *= p;
+    }
+    /* every further power of p multiplies by p; no divisions */
+    for (pk = p * p; ; pk *= p) {
+      for (long m = (lo + pk - 1) / pk * pk; m < hi; m += pk) {
+        phi[m - lo] *= p;
+        prod[m - lo] *= p;
+      }
+      if (pk > (unsigned long)(hi - 1) / p)
+        break;
+    }
+  }
+  /* the cofactor is 1 or a prime above sqrt(hi-1) */
+  for (long k = 0; k < len; k++) {
+    unsigned long r = (lo + k) / prod[k];
+
+    if (r > 1)
+      phi[k] *= r - 1;
+  }
+  /* euler(0) = euler(1) = 0, unlike phi(1) */
+  for (long k = 0; k < len && lo + k < 2; k++)
+    phi[k] = 0;
+}
+
+__int128 totientSieveSum( long lower, long upper)
+{
+  long nprimes, nsegments;
+  long *primes;
+  __int128 sum = 0;
+
+  if (lower < 2)
+    lower = 2;
+  if (upper < lower)
+    return 0;
+
+  primes = totientPrimes( (long) sqrtl( (long double) upper) + 1, &nprimes);
+  nsegments = (upper - lower) / TOTIENT_SEGMENT + 1;
+
+#pragma omp parallel reduction(+:sum)
+  {
+    unsigned long *phi = (unsigned long *) malloc (TOTIENT_SEGMENT * sizeof (unsigned long));
+    unsigned long *prod = (unsigned long *) malloc (TOTIENT_SEGMENT * sizeof (unsigned long));
+
+#pragma omp for schedule(dynamic, 1)
+    for (long s = 0; s < nsegments; s++) {
+      long lo = lower + s * TOTIENT_SEGMENT;
+      long hi = (upper - lo < TOTIENT_SEGMENT ? upper + 1 : lo + TOTIENT_SEGMENT);
+
+      unsigned long part = 0;
+
+      totientSieveSegment( lo, hi, primes, nprimes, phi, prod);
+      for (long k = 0; k < hi - lo; k++)
+        part += phi[k];
+      sum += part;
+    }
+    free( phi);
+    free( prod);
+  }
+
+  free( primes);
+  return sum;
+}
+
+/* Phi(k) = phi(1) + ... + phi(k) for k <= limit */
+static unsigned long *summatoryTable( long limit)
+{
+  unsigned long *table = (unsigned long *) malloc ((limit + 1) * sizeof (unsigned long));
+  long nsegments = limit / TOTIENT_SEGMENT + 1;
+  long nprimes;
+  long *primes = totientPrimes( (long) sqrtl( (long double) limit) + 1, &nprimes);
+
+#pragma omp parallel
+  {
+    unsigned long *prod = (unsigned long *) malloc (TOTIENT_SEGMENT * sizeof (unsigned long));
+
+#pragma omp for schedule(dynamic, 1)
+    for (long s = 0; s < nsegments; s++) {
+      long lo = s * TOTIENT_SEGMENT;
+      long hi = (limit - lo < TOTIENT_SEGMENT ? limit + 1 : lo + TOTIENT_SEGMENT);
+
+      totientSieveSegment( lo, hi, primes, nprimes, table + lo, prod);
+    }
+    free( prod);
+  }
+  free( primes);
+
+  if (limit >= 1)
+    table[1] = 1;
+  for (long k = 1; k <= limit; k++)
+    table[k] += table[k-1];
+  return table;
+}
+
+__int128 totientSummatory( long n)
+{
+  long limit, count;
+  unsigned long *small;
+  __int128 *big, result;
+
+  if (n < 1)
+    return 0;
+  limit = (long) cbrtl( (long double) n * n);
+  if (limit > TOTIENT_TABLE_MAX)
+    limit = TOTIENT_TABLE_MAX;
+  if (limit > n)
+    limit = n;
+  small = summatoryTable( limit);
+  if (n == limit) {
+    result = small[n];
+    free( small);
+    return result;
+  }
+
+  /* big[d] = Phi(n/d) for the d with n/d > limit, i.e. d <= count. Every
+   * floor(n/d/k) is floor(n/(d*k)), so the values needed for big[d] are in
+   * the table or at big[d*k], computed before as d goes down. */
+  count = n / (limit + 1);
+  big = (__int128 *) malloc ((count + 1) * sizeof (__int128));
+  for (long d = count; d >= 1; d--) {
+    long v = n / d;
+    __int128 sum = (__int128) v * (v + 1) / 2;
+
+    /* k runs over the blocks of equal quotient q = v/k */
+    for (long k = 2; k <= v; ) {
+      long q = v / k;
+      long last = v / q;
+
+      if (q <= limit)
+        sum -= (__int128)(last - k + 1) * small[q];
+      else
+        sum -= (__int128)(last - k + 1) * big[d * k];
+      k = last + 1;
+    }
+    big[d] = sum;
+  }
+  result = big[1];
+  free( big);
+  free( small);
+  return result;
+}
+
+__int128 totientSumRange( long lower, long upper)
+{
+  if (lower < 2)
+    lower = 2;
+  if (upper < lower)
+    return 0;
+  return totientSummatory( upper) - totientSummatory( lower - 1);
+}
+
+char *totientFormat( __int128 x, char *buf)
+{
+  char digits[48];
+  char *p = buf;
+  int len = 0, neg = x < 0;
+  unsigned __int128 u = neg ? -(unsigned __int128) x : (unsigned __int128) x;
+
+  do {
+    digits[len++] = '0' + (int)(u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (neg)
+    *p++ = '-';
+  while (len > 0)
+    *p++ = digits[--len];
+  *p = '\0';
+  return buf;
+}
+
+unsigned long totientGcd( unsigned long x, unsigned long y)
+{
+  int shift;
+
+  if (x == 0)
+    return y;
+  if (y == 0)
+    return x;
+  shift = __builtin_ctzl( x | y);
+  x >>= __builtin_ctzl( x);
+  /* x is odd from here on */
+  do {
+    y >>= __builtin_ctzl( y);
+    if (x > y) {
+      unsigned long t = x;
+      x = y;
+      y = t;
+    }
+    y -= x;
+  } while (y != 0);
+  return x << shift;
+}
+
+static long eulerScalar( long n)
+{
+  long length = 0;
+
+  for (long j = 1; j < n; j++)
+    length += (totientGcd( n, j) == 1);
+  return length;
+}
+
+/* The vector kernels below use that gcd(n, j) = 1 iff j is odd or n is,
+ * and the odd parts of n and j are coprime. Each lane runs the binary gcd
+ * of odd u and v: (u, v) <- (min, |u-v| without its trailing zeros) until
+ * v = u, which is then the gcd. */
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("avx2")))
+static long eulerAvx2( long n)
+{
+  unsigned int odd = (unsigned int)(n >> __builtin_ctzl( n));
+  const __m256i one = _mm256_set1_epi32( 1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i u0 = _mm256_set1_epi32( (int) odd);
+  const __m256i bias = _mm256_set1_epi32( 127);
+  /* even n: only odd j count */
+  const __m256i jmask = _mm256_set1_epi32( n % 2 == 0 ? 1 : 0);
+  __m256i count = zero;
+  __m256i j = _mm256_setr_epi32( 1, 2, 3, 4, 5, 6, 7, 8);
+  long length;
+
+  for (long j0 = 1; j0 < n; j0 += 8) {
+    __m256i u = u0, v, d, low, tz;
+    __m256i valid = _mm256_cmpgt_epi32( _mm256_set1_epi32( (int)(n - j0 < 8 ? n - j0 : 8)),
+                                        _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7));
+
+    /* v = odd part of j; ctz from the float exponent of the lowest bit
+     * (2^31 converts to -2^31, the exponent is the same) */
+    low = _mm256_and_si256( j, _mm256_sub_epi32( zero, j));
+    tz = _mm256_sub_epi32( _mm256_and_si256( _mm256_srli_epi32(
+           _mm256_castps_si256( _mm256_cvtepi32_ps( low)), 23), _mm256_set1_epi32( 0xff)), bias);
+    v = _mm256_srlv_epi32( j, tz);
+    /* lanes past n - 1 (j may have wrapped to 0) start done */
+    v = _mm256_blendv_epi8( u, v, valid);
+    while (_mm256_movemask_epi8( _mm256_cmpeq_epi32( u, v)) != -1) {
+      __m256i m = _mm256_min_epu32( u, v);
+      d = _mm256_sub_epi32( _mm256_max_epu32( u, v), m);
+      low = _mm256_and_si256( d, _mm256_sub_epi32( zero, d));
+      tz = _mm256_sub_epi32( _mm256_and_si256( _mm256_srli_epi32(
+             _mm256_castps_si256( _mm256_cvtepi32_ps( low)), 23), _mm256_set1_epi32( 0xff)), bias);
+      d = _mm256_srlv_epi32( d, tz);
+      /* d = 0: the lane is done, v = u */
+      v = _mm256_blendv_epi8( d, m, _mm256_cmpeq_epi32( d, zero));
+      u = m;
+    }
+    count = _mm256_sub_epi32( count, _mm256_and_si256( _mm256_and_si256( valid,
+              _mm256_cmpeq_epi32( u, one)),
+              _mm256_cmpeq_epi32( _mm256_and_si256( _mm256_andnot_si256( j, one), jmask), zero)));
+    j = _mm256_add_epi32( j, _mm256_set1_epi32( 8));
+  }
+
+  /* lane counts add up to at most n - 1 < 2^32 */
+  {
+    unsigned int c[8];
+
+    _mm256_storeu_si256( (__m256i *) c, count);
+    length = 0;
+    for (int k = 0; k < 8; k++)
+      length += c[k];
+  }
+  return length;
+}
+
+__attribute__((target("avx512f,avx512cd")))
+static long eulerAvx512( long n)
+{
+  unsigned int odd = (unsigned int)(n >> __builtin_ctzl( n));
+  const __m512i u0 = _mm512_set1_epi32( (int) odd);
+  const __m512i one = _mm512_set1_epi32( 1);
+  const __m512i thirtyone = _mm512_set1_epi32( 31);
+  const __m512i lanes = _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m512i j = _mm512_add_epi32( lanes, one);
+  long length = 0;
+
+  for (long j0 = 1; j0 < n; j0 += 16) {
+    __m512i u = u0, v, d, tz;
+    __mmask16 inside = _mm512_cmpgt_epi32_mask( _mm512_set1_epi32( (int)(n - j0 < 16 ? n - j0 : 16)), lanes);
+    __mmask16 valid = inside, done;
+
+    /* even n: only odd j count */
+    if (n % 2 == 0)
+      valid &= _mm512_test_epi32_mask( j, one);
+    tz = _mm512_sub_epi32( thirtyone, _mm512_lzcnt_epi32( _mm512_and_si512( j,
+           _mm512_sub_epi32( _mm512_setzero_si512(), j))));
+    /* lanes past n - 1 (j may have wrapped to 0) start done */
+    v = _mm512_mask_mov_epi32( u, inside, _mm512_srlv_epi32( j, tz));
+    while ((done = _mm512_cmpeq_epi32_mask( u, v)) != 0xffff) {
+      __m512i m = _mm512_min_epu32( u, v);
+      d = _mm512_sub_epi32( _mm512_max_epu32( u, v), m);
+      tz = _mm512_sub_epi32( thirtyone, _mm512_lzcnt_epi32( _mm512_and_si512( d,
+             _mm512_sub_epi32( _mm512_setzero_si512(), d))));
+      /* d = 0: the lane is done, v = u */
+      v = _mm512_mask_mov_epi32( _mm512_srlv_epi32( d, tz),
+                                 _mm512_cmpeq_epi32_mask( d, _mm512_setzero_si512()), m);
+      u = m;
+    }
+    length += __builtin_popcount( valid & _mm512_cmpeq_epi32_mask( u, one));
+    j = _mm512_add_epi32( j, _mm512_set1_epi32( 16));
+  }
+  return length;
+}
+
+#endif
+
+typedef long (*euler_fn)( long);
+
+static euler_fn eulerKernel( const char **name)
+{
+  const char *dummy;
+
+  if (name == NULL)
+    name = &dummy;
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports( "avx512f") && __builtin_cpu_supports( "avx512cd")) {
+    *name = "avx512 16 lanes";
+    return eulerAvx512;
+  }
+  if (__builtin_cpu_supports( "avx2")) {
+    *name = "avx2 8 lanes";
+    return eulerAvx2;
+  }
+#endif
+  *name = "scalar binary gcd";
+  return eulerScalar;
+}
+
+const char *totientEulerKernelName( void)
+{
+  const char *name;
+
+  eulerKernel( &name);
+  return name;
+}
+
+long totientEulerGcd( long n)
+{
+  if (n < 2)
+    return 0;
+  if (n > 0xffffffffL)
+    return eulerScalar( n);
+  return eulerKernel( NULL)( n);
+}
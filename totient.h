@@ -0,0 +1,61 @@
+#ifndef TOTIENT_H
+#define TOTIENT_H
+
+/* Euler's totient: sums over ranges without a gcd per pair, and the gcd
+ * count itself.
+ *
+ * As in trsequential.c, euler(n) counts the 1 <= j < n coprime to n, so
+ * euler(0) = euler(1) = 0 and euler(n) = phi(n) for n >= 2.
+ *
+ * The segmented sieve takes the primes up to sqrt(upper) once and then
+ * works through [lower, upper] in segments of TOTIENT_SEGMENT numbers
+ * (two 64-bit words each, sized to stay in L2): every prime p strikes the
+ * multiples of p in the segment with p-1 and the multiples of each higher
+ * power of p with p, and tracks the factored part of n; the one division
+ * per n that is left yields the cofactor, 1 or a prime above sqrt(upper).
+ * The OpenMP threads take whole segments.
+ */
+
+#define TOTIENT_SEGMENT (1 << 14)
+
+/* Phi(n) = phi(1) + ... + phi(n) in about O(n^(2/3)): Phi is tabulated by
+ * the sieve up to limit = n^(2/3) (at most TOTIENT_TABLE_MAX, 128 MB), and
+ * the identity sum_{k=1..v} Phi(v/k) = v(v+1)/2 gives Phi(v) for the
+ * larger v = n/d from the values at n/(d*k), memoised by d, with the k of
+ * equal quotient v/k taken as one block. Sums are 128 bit: Phi(n) passes
+ * 2^63 near n = 5.5e9.  */
+#define TOTIENT_TABLE_MAX (1L << 24)
+
+/* sum of euler(n) for lower <= n <= upper */
+__int128 totientSieveSum( long lower, long upper);
+
+/* the same sum as Phi(upper) - Phi(lower-1), without phi(1) */
+__int128 totientSumRange( long lower, long upper);
+
+__int128 totientSummatory( long n);
+
+/* Stein's binary gcd: shifts by the trailing zero count and subtractions
+ * instead of the 20-90 cycle 64-bit divisions of Euclid's algorithm */
+unsigned long totientGcd( unsigned long x, unsigned long y);
+
+/* euler(n) by definition, counting the j < n with gcd(n, j) = 1. For
+ * n < 2^32 the binary gcd runs on 16 (AVX-512) or 8 (AVX2) values of j
+ * at once in 32-bit lanes, selected at runtime; a lane that is done
+ * waits for the others.  */
+long totientEulerGcd( long n);
+
+/* name of the gcd kernel totientEulerGcd uses on this CPU */
+const char *totientEulerKernelName( void);
+
+/* decimal digits of x into buf (at least 41 chars); returns buf */
+char *totientFormat( __int128 x, char *buf);
+
+/* phi[k] = euler(lo+k) for lo <= lo+k < hi, with the primes up to at
+ * least sqrt(hi-1); prod is scratch of the same length */
+void totientSieveSegment( long lo, long hi, const long *primes, long nprimes,
+                          unsigned long *phi, unsigned long *prod);
+
+/* primes up to limit in a new array; the count goes to *nprimes */
+long *totientPrimes( long limit, long *nprimes);
+
+#endif
@@ -1,40 +1,82 @@
-__kernel void calculateTR(__global const float *a,
-	__global const float *b,
-	__global float *c) {
-		
-		int gid = get_global_id(0);
-		c[gid] = a[gid] + b[gid];
-    
-    int i,j,x,y,t;
-    long lower, upper;
-    long sum, length;
-    
-    lower = a;
-    upper = b;
-    
-    sum = 0;
-    
-    for (i = lower; i <= upper; i++)
+// Sum of the totients between lower and upper on the device.
+//
+// As in trsequential.c, euler(n) counts the 1 <= j < n coprime to n, so
+// euler(0) = euler(1) = 0. Instead of a gcd per pair every work-item
+// factors its n by trial division with the primes up to sqrt(upper),
+// sieved on the host: phi(n) = n * prod (1 - 1/p) over the primes p | n.
+
+// euler(n); primes must reach sqrt(n)
+ulong totient(ulong n, __global const uint *primes, uint nprimes)
+{
+    __private ulong r = n;
+    __private ulong phi = 1;
+    __private uint i, p;
+
+    if (n < 2)
     {
-        length = 0;
-        for (j = 1; j < i; j++)
+        return 0;
+    }
+    for (i = 0; i < nprimes; i++)
+    {
+        p = primes[i];
+        if ((ulong)p * p > r)
+        {
+            break;
+        }
+        // 32 bit remainders once r fits: 64 bit division is several
+        // times slower on most devices
+        if ((r >> 32) == 0 ? (uint)r % p == 0 : r % p == 0)
         {
-            t=0;
-            x=i;
-            y=j;
+            r /= p;
+            phi *= p - 1;
+            while (r % p == 0)
             {
-                while (y != 0) {
-                    t = x % y;
-                    x = y;
-                    y = t;
-                }
+                r /= p;
+                phi *= p;
             }
-            if (x==1)
-                length++;
         }
-        sum = sum + length;
     }
-    
-    c = sum;
-    
-	}
+    // the cofactor is 1 or a prime above sqrt(n)
+    if (r > 1)
+    {
+        phi *= r - 1;
+    }
+    return phi;
+}
+
+// Every work-item sums euler(n) over every global_size-th n of
+// [lower, upper], neighbouring work-items taking neighbouring n. The
+// work-group's sum, 64 bit, goes to partialSums[group id]; scratch needs
+// one ulong per work-item.
+__kernel void calculateTR(ulong lower, ulong upper,
+                          __global const uint *primes, uint nprimes,
+                          __global ulong *partialSums, __local ulong *scratch)
+{
+    __private const uint lid = get_local_id(0);
+    __private uint n = get_local_size(0);
+    __private ulong sum = 0;
+    __private ulong i;
+
+    for (i = lower + get_global_id(0); i <= upper; i += get_global_size(0))
+    {
+        sum += totient(i, primes, nprimes);
+    }
+
+    // tree reduction within the work-group
+    scratch[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    while (n > 1)
+    {
+        __private uint h = (n + 1) / 2;
+        if (lid < n - h)
+        {
+            scratch[lid] += scratch[lid + h];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        n = h;
+    }
+    if (lid == 0)
+    {
+        partialSums[get_group_id(0)] = scratch[0];
+    }
+}
@@ -10,8 +10,19 @@
 
 #include "timer.h"
 #include "simple.h"
+#include "transpose_host.h"
+#include "philox.h"
 
 #define DATA_SIZE 4096
+#define SEED 42
+
+/* VERSION5 also handles non-square matrices, e.g. -DDATA_COLS=3000 */
+#ifndef DATA_ROWS
+#define DATA_ROWS DATA_SIZE
+#endif
+#ifndef DATA_COLS
+#define DATA_COLS DATA_SIZE
+#endif
 
 #ifdef VERSION1
 
@@ -64,6 +75,50 @@ const char *KernelSource =                                   "\n"
   "}                                                          \n"
   "\n";
 
+#elif defined VERSION5
+
+/* Tiled transpose of a rows x cols matrix into a cols x rows one.
+ * The tile is get_local_size(0) square and padded to sz+1 floats per row,
+ * so the column-wise reads from shmem hit a different bank per work-item.
+ * Each work-item moves sz/get_local_size(1) elements, which removes the
+ * need for square work-groups. Work-group ids are re-mapped diagonally so
+ * that concurrently running groups do not all hit the same memory
+ * partition when the matrix dimensions are powers of two.
+ */
+const char *KernelSource =                                               "\n"
+  "__kernel void transpose(                                               \n"
+  "   __global float* input,                                              \n"
+  "   __global float* output,                                             \n"
+  "   const unsigned int rows,                                            \n"
+  "   const unsigned int cols,                                            \n"
+  "   __local float* shmem)                                               \n"
+  "{                                                                      \n"
+  "   int li = get_local_id(0);                                           \n"
+  "   int lj = get_local_id(1);                                           \n"
+  "   int sz = get_local_size(0);                                         \n"
+  "   int step = get_local_size(1);                                       \n"
+  "   int ngi = get_num_groups(0);                                        \n"
+  "   int ngj = get_num_groups(1);                                        \n"
+  "                                                                       \n"
+  "   /* diagonal block ordering */                                       \n"
+  "   int bid = get_group_id(0) + ngi*get_group_id(1);                    \n"
+  "   int gj = bid % ngj;                                                 \n"
+  "   int gi = (bid/ngj + gj) % ngi;                                      \n"
+  "                                                                       \n"
+  "   int i = gi*sz + li;                                                 \n"
+  "   int j = gj*sz + lj;                                                 \n"
+  "     for( int k=0; k<sz; k+=step)                                      \n"
+  "       if( i < cols && j+k < rows)                                     \n"
+  "         shmem[(lj+k)*(sz+1)+li] = input[(j+k)*cols+i];                \n"
+  "     barrier( CLK_LOCAL_MEM_FENCE);                                    \n"
+  "   i = gj*sz + li;                                                     \n"
+  "   j = gi*sz + lj;                                                     \n"
+  "     for( int k=0; k<sz; k+=step)                                      \n"
+  "       if( i < rows && j+k < cols)                                     \n"
+  "         output[(j+k)*rows+i] = shmem[li*(sz+1)+lj+k];                 \n"
+  "}                                                                      \n"
+  "\n";
+
 #else 
 
 const char *KernelSource =                                   "\n"
@@ -103,21 +158,40 @@ void printTimeElapsed( char *text)
   printf( "%s: %f msec\n", text, elapsed);
 }
 
-void timeDirectImplementation( int count, float* data, float* results)
+void timeDirectImplementation( int rows, int cols, float* data, float* results)
 {
   TIMERwc_time( &startsec, &startnsec);
 
+#ifdef VERSION5
+  for (int i = 0; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      results[j*rows+i] = data[i*cols+j];
+#else
+  int count = rows;
   for (int i = 0; i < count; i++)
     for (int j = 0; j < count; j++)
 #if defined VERSION1 || VERSION3
       results[i*count+j] = data[j*count+i];
 #else
       results[j*count+i] = data[i*count+j];
+#endif
 #endif
 
   TIMERwc_time( &stopsec, &stopnsec);
 
   printTimeElapsed( "kernel equivalent on host");
+
+  /* every version computes results = transpose(data) */
+  TIMERwc_time( &startsec, &startnsec);
+  transposeHost( data, results, rows, cols, 0);
+  TIMERwc_time( &stopsec, &stopnsec);
+  printf( "blocked %s ", transposeHostKernelName());
+  printTimeElapsed( "transpose on host");
+
+  TIMERwc_time( &startsec, &startnsec);
+  transposeHost( data, results, rows, cols, 1);
+  TIMERwc_time( &stopsec, &stopnsec);
+  printTimeElapsed( "same with streaming stores");
 }
 
 
@@ -130,7 +204,11 @@ int main (int argc, char * argv[])
 
   if( argc <3) {
     local[0] = 32;
+#ifdef VERSION5
+    local[1] = 8;
+#else
     local[1] = 32;
+#endif
   } else {
     local[0] = atoi(argv[1]);
     local[1] = atoi(argv[2]);
@@ -144,6 +222,11 @@ int main (int argc, char * argv[])
 #elif defined VERSION4
   if( local[0] != local[1])
     die( "Error: version 4 requires quadratic workgroups size!");
+#elif defined VERSION5
+  if( local[0] % local[1] != 0) {
+    die( "Error: version 5 requires the second workgroup dimension to divide the first!");
+    return 1;
+  }
 #endif
 
   /* Create data for the run.  */
@@ -151,17 +234,27 @@ int main (int argc, char * argv[])
   float *results = NULL;             /* Results returned from device.  */
   int correct;                       /* Number of correct results returned.  */
 
-  int count = DATA_SIZE;
+  int rows = DATA_ROWS;
+  int cols = DATA_COLS;
+#ifdef VERSION5
+  /* one work-group per tile, local[1] rows of the tile per pass */
+  global[0] = (cols + local[0] - 1) / local[0] * local[0];
+  global[1] = (rows + local[0] - 1) / local[0] * local[1];
+#else
+  if( rows != cols) {
+    die( "Error: only version 5 supports non-square matrices!");
+    return 1;
+  }
+  int count = rows;
   global[0] = count;
   global[1] = count;
+#endif
 
-  data = (float *) malloc (count * count * sizeof (float));
-  results = (float *) malloc (count * count * sizeof (float));
+  data = (float *) malloc (rows * cols * sizeof (float));
+  results = (float *) malloc (rows * cols * sizeof (float));
 
   /* Fill the vector with random float values.  */
-  for (int i = 0; i < count; i++)
-    for (int j = 0; j < count; j++)
-      data[i*count+j] = rand () / (float) RAND_MAX;
+  philoxUniform( SEED, 0, data, (size_t)rows*cols);
 
 
   TIMERwc_time( &startsec, &startnsec);
@@ -175,7 +268,13 @@ int main (int argc, char * argv[])
   }
 
   if( err == CL_SUCCESS) {
-#if defined VERSION3 || defined VERSION4
+#if defined VERSION5
+    kernel = setupKernel( KernelSource, "transpose", 5, FloatArr, rows*cols, data,
+                                                        FloatArr, rows*cols, results,
+                                                        IntConst, rows,
+                                                        IntConst, cols,
+                                                        LocalFloat, local[0]*(local[0]+1));
+#elif defined VERSION3 || defined VERSION4
     kernel = setupKernel( KernelSource, "transpose", 4, FloatArr, count*count, data,
                                                         FloatArr, count*count, results,
                                                         IntConst, count,
@@ -198,20 +297,26 @@ int main (int argc, char * argv[])
 
     /* Validate our results.  */
     correct = 0;
-    for (int i = 0; i < count; i++)
-      for (int j = 0; j < count; j++)
-        if (results[i*count+j] == data[j*count+i])
+    for (int i = 0; i < rows; i++)
+      for (int j = 0; j < cols; j++)
+        if (results[j*rows+i] == data[i*cols+j])
           correct++;
 
     /* Print a brief summary detailing the results.  */
-    printf ("Computed %d/%d %2.0f%% correct values\n", correct, count*count,
-            ((float)correct/(float)(count*count))*100.f);
+    printf ("Computed %d/%d %2.0f%% correct values\n", correct, rows*cols,
+            ((float)correct/(float)(rows*cols))*100.f);
 
     err = clReleaseKernel (kernel);
     err = freeDevice();
 
-    timeDirectImplementation( count, data, results);
+    timeDirectImplementation( rows, cols, data, results);
     
+  } else {
+    printf( "no openCL device, using the host transpose!\n");
+    TIMERwc_time( &startsec, &startnsec);
+    transposeHost( data, results, rows, cols, 1);
+    TIMERwc_time( &stopsec, &stopnsec);
+    printTimeElapsed( "transpose on host");
   }
 
 
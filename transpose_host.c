@@ -0,0 +1,204 @@
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "transpose_host.h"
+
+/* copy dst[j*ld_dst+i] = src[i*ld_src+j] for an h x w patch */
+static void transposeScalar( const float *src, long ld_src, float *dst, long ld_dst,
+                             long h, long w)
+{
+  for (long i = 0; i < h; i++)
+    for (long j = 0; j < w; j++)
+      dst[j*ld_dst+i] = src[i*ld_src+j];
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("avx2")))
+static void transpose8x8( const float *src, long ld_src, float *dst, long ld_dst, int nt)
+{
+  __m256 r0 = _mm256_loadu_ps( src + 0*ld_src);
+  __m256 r1 = _mm256_loadu_ps( src + 1*ld_src);
+  __m256 r2 = _mm256_loadu_ps( src + 2*ld_src);
+  __m256 r3 = _mm256_loadu_ps( src + 3*ld_src);
+  __m256 r4 = _mm256_loadu_ps( src + 4*ld_src);
+  __m256 r5 = _mm256_loadu_ps( src + 5*ld_src);
+  __m256 r6 = _mm256_loadu_ps( src + 6*ld_src);
+  __m256 r7 = _mm256_loadu_ps( src + 7*ld_src);
+
+  /* interleave pairs of rows */
+  __m256 t0 = _mm256_unpacklo_ps( r0, r1);
+  __m256 t1 = _mm256_unpackhi_ps( r0, r1);
+  __m256 t2 = _mm256_unpacklo_ps( r2, r3);
+  __m256 t3 = _mm256_unpackhi_ps( r2, r3);
+  __m256 t4 = _mm256_unpacklo_ps( r4, r5);
+  __m256 t5 = _mm256_unpackhi_ps( r4, r5);
+  __m256 t6 = _mm256_unpacklo_ps( r6, r7);
+  __m256 t7 = _mm256_unpackhi_ps( r6, r7);
+
+  /* gather 4-element columns within each 128 bit lane */
+  r0 = _mm256_shuffle_ps( t0, t2, _MM_SHUFFLE(1,0,1,0));
+  r1 = _mm256_shuffle_ps( t0, t2, _MM_SHUFFLE(3,2,3,2));
+  r2 = _mm256_shuffle_ps( t1, t3, _MM_SHUFFLE(1,0,1,0));
+  r3 = _mm256_shuffle_ps( t1, t3, _MM_SHUFFLE(3,2,3,2));
+  r4 = _mm256_shuffle_ps( t4, t6, _MM_SHUFFLE(1,0,1,0));
+  r5 = _mm256_shuffle_ps( t4, t6, _MM_SHUFFLE(3,2,3,2));
+  r6 = _mm256_shuffle_ps( t5, t7, _MM_SHUFFLE(1,0,1,0));
+  r7 = _mm256_shuffle_ps( t5, t7, _MM_SHUFFLE(3,2,3,2));
+
+  /* swap the 128 bit lanes */
+  t0 = _mm256_permute2f128_ps( r0, r4, 0x20);
+  t1 = _mm256_permute2f128_ps( r1, r5, 0x20);
+  t2 = _mm256_permute2f128_ps( r2, r6, 0x20);
+  t3 = _mm256_permute2f128_ps( r3, r7, 0x20);
+  t4 = _mm256_permute2f128_ps( r0, r4, 0x31);
+  t5 = _mm256_permute2f128_ps( r1, r5, 0x31);
+  t6 = _mm256_permute2f128_ps( r2, r6, 0x31);
+  t7 = _mm256_permute2f128_ps( r3, r7, 0x31);
+
+  if (nt) {
+    _mm256_stream_ps( dst + 0*ld_dst, t0);
+    _mm256_stream_ps( dst + 1*ld_dst, t1);
+    _mm256_stream_ps( dst + 2*ld_dst, t2);
+    _mm256_stream_ps( dst + 3*ld_dst, t3);
+    _mm256_stream_ps( dst + 4*ld_dst, t4);
+    _mm256_stream_ps( dst + 5*ld_dst, t5);
+    _mm256_stream_ps( dst + 6*ld_dst, t6);
+    _mm256_stream_ps( dst + 7*ld_dst, t7);
+  } else {
+    _mm256_storeu_ps( dst + 0*ld_dst, t0);
+    _mm256_storeu_ps( dst + 1*ld_dst, t1);
+    _mm256_storeu_ps( dst + 2*ld_dst, t2);
+    _mm256_storeu_ps( dst + 3*ld_dst, t3);
+    _mm256_storeu_ps( dst + 4*ld_dst, t4);
+    _mm256_storeu_ps( dst + 5*ld_dst, t5);
+    _mm256_storeu_ps( dst + 6*ld_dst, t6);
+    _mm256_storeu_ps( dst + 7*ld_dst, t7);
+  }
+}
+
+__attribute__((target("avx512f")))
+static void transpose16x16( const float *src, long ld_src, float *dst, long ld_dst, int nt)
+{
+  __m512 r[16], t[16];
+  int k;
+
+  for (k = 0; k < 16; k++)
+    r[k] = _mm512_loadu_ps( src + k*ld_src);
+
+  /* interleave pairs of rows, then gather 4-element columns per lane */
+  for (k = 0; k < 16; k += 2) {
+    t[k]   = _mm512_unpacklo_ps( r[k], r[k+1]);
+    t[k+1] = _mm512_unpackhi_ps( r[k], r[k+1]);
+  }
+  for (k = 0; k < 16; k += 4) {
+    r[k]   = _mm512_shuffle_ps( t[k],   t[k+2], _MM_SHUFFLE(1,0,1,0));
+    r[k+1] = _mm512_shuffle_ps( t[k],   t[k+2], _MM_SHUFFLE(3,2,3,2));
+    r[k+2] = _mm512_shuffle_ps( t[k+1], t[k+3], _MM_SHUFFLE(1,0,1,0));
+    r[k+3] = _mm512_shuffle_ps( t[k+1], t[k+3], _MM_SHUFFLE(3,2,3,2));
+  }
+
+  /* r[4*q+c] now holds column c of the 4x4 sub-blocks of rows 4q..4q+3,
+   * lane l covering columns 4l..4l+3; permute the 128 bit lanes */
+  for (k = 0; k < 4; k++) {
+    __m512 a = _mm512_shuffle_f32x4( r[k],   r[4+k],  _MM_SHUFFLE(2,0,2,0));
+    __m512 b = _mm512_shuffle_f32x4( r[k],   r[4+k],  _MM_SHUFFLE(3,1,3,1));
+    __m512 c = _mm512_shuffle_f32x4( r[8+k], r[12+k], _MM_SHUFFLE(2,0,2,0));
+    __m512 d = _mm512_shuffle_f32x4( r[8+k], r[12+k], _MM_SHUFFLE(3,1,3,1));
+    t[k]    = _mm512_shuffle_f32x4( a, c, _MM_SHUFFLE(2,0,2,0));
+    t[8+k]  = _mm512_shuffle_f32x4( a, c, _MM_SHUFFLE(3,1,3,1));
+    t[4+k]  = _mm512_shuffle_f32x4( b, d, _MM_SHUFFLE(2,0,2,0));
+    t[12+k] = _mm512_shuffle_f32x4( b, d, _MM_SHUFFLE(3,1,3,1));
+  }
+
+  if (nt) {
+    for (k = 0; k < 16; k++)
+      _mm512_stream_ps( dst + k*ld_dst, t[k]);
+  } else {
+    for (k = 0; k < 16; k++)
+      _mm512_storeu_ps( dst + k*ld_dst, t[k]);
+  }
+}
+
+#else /* no x86 SIMD: only the scalar path is ever taken */
+
+static void transpose8x8( const float *src, long ld_src, float *dst, long ld_dst, int nt)
+{
+  transposeScalar( src, ld_src, dst, ld_dst, 8, 8);
+}
+
+#define transpose16x16 transpose8x8
+#define _mm_sfence() do {} while (0)
+
+#endif
+
+typedef void (*tile_fn)( const float *, long, float *, long, int);
+
+static int tileSize( void)
+{
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports( "avx512f"))
+    return 16;
+  if (__builtin_cpu_supports( "avx2"))
+    return 8;
+#endif
+  return 1;
+}
+
+const char *transposeHostKernelName( void)
+{
+  switch (tileSize()) {
+    case 16: return "avx512 16x16";
+    case 8:  return "avx2 8x8";
+    default: return "scalar";
+  }
+}
+
+void transposeHostStrided( const float *src, long ld_src, float *dst, long ld_dst,
+                           long rows, long cols, int nt)
+{
+  int ts = tileSize();
+  tile_fn tile = (ts == 16 ? transpose16x16 : transpose8x8);
+  long nbi = (rows + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+  long nbj = (cols + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+
+  /* streaming stores need every destination row aligned to the vector */
+  if (nt && (((uintptr_t) dst % (ts * sizeof (float))) != 0 || ld_dst % ts != 0))
+    nt = 0;
+
+#pragma omp parallel for collapse(2) schedule(static)
+  for (long bi = 0; bi < nbi; bi++)
+    for (long bj = 0; bj < nbj; bj++) {
+      long i0 = bi * TRANSPOSE_BLOCK;
+      long j0 = bj * TRANSPOSE_BLOCK;
+      long h = (rows - i0 < TRANSPOSE_BLOCK ? rows - i0 : TRANSPOSE_BLOCK);
+      long w = (cols - j0 < TRANSPOSE_BLOCK ? cols - j0 : TRANSPOSE_BLOCK);
+      long hv = (ts > 1 ? h / ts * ts : 0);
+      long wv = (ts > 1 ? w / ts * ts : 0);
+
+      for (long i = 0; i < hv; i += ts)
+        for (long j = 0; j < wv; j += ts)
+          tile( src + (i0+i)*ld_src + j0+j, ld_src, dst + (j0+j)*ld_dst + i0+i, ld_dst, nt);
+
+      /* ragged right and bottom edges of the block */
+      transposeScalar( src + i0*ld_src + j0+wv, ld_src, dst + (j0+wv)*ld_dst + i0, ld_dst, h, w-wv);
+      transposeScalar( src + (i0+hv)*ld_src + j0, ld_src, dst + j0*ld_dst + i0+hv, ld_dst, h-hv, wv);
+    }
+
+  if (nt)
+    _mm_sfence();
+}
+
+void transposeHost( const float *src, float *dst, long rows, long cols, int nt)
+{
+  transposeHostStrided( src, cols, dst, rows, rows, cols, nt);
+}
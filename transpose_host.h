@@ -0,0 +1,27 @@
+#ifndef TRANSPOSE_HOST_H
+#define TRANSPOSE_HOST_H
+
+/* Cache-blocked, SIMD, multithreaded transpose on the host.
+ *
+ * dst (cols x rows) = transpose of src (rows x cols), both row-major.
+ * The matrix is cut into TRANSPOSE_BLOCK x TRANSPOSE_BLOCK blocks that are
+ * distributed over the OpenMP threads; inside a block 8x8 (AVX2) or
+ * 16x16 (AVX-512) register tiles are transposed with unpack/permute
+ * shuffles, selected at runtime. With nt != 0 the stores bypass the cache
+ * (only used when dst is suitably aligned).
+ */
+
+#ifndef TRANSPOSE_BLOCK
+#define TRANSPOSE_BLOCK 64
+#endif
+
+void transposeHost( const float *src, float *dst, long rows, long cols, int nt);
+
+/* same for sub-matrices: dst[j*ld_dst+i] = src[i*ld_src+j] */
+void transposeHostStrided( const float *src, long ld_src, float *dst, long ld_dst,
+                           long rows, long cols, int nt);
+
+/* name of the register kernel transposeHost will use on this CPU */
+const char *transposeHostKernelName( void);
+
+#endif
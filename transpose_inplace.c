@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "timer.h"
+
+/* In-place transpose of a rows x cols float matrix.
+ *
+ * Square matrices are transposed by swapping pairs of tiles (i,j) and (j,i)
+ * through local memory. Rectangular matrices are transposed by cycle
+ * following: the element at q in the result comes from
+ * src(q) = (q%rows)*cols + q/rows, and the permutation decomposes into
+ * disjoint cycles that can be rotated independently. Typical shapes have
+ * only a handful of long cycles (3000 x 4096 has 2), so one work-item per
+ * cycle would run serially: the host walks the cycles once, with a
+ * visited bit vector (rows*cols/8 bytes), and cuts them into segments of
+ * SEGMENT positions. The device saves the first value of every segment,
+ * then rotates all segments in parallel, each ending with the saved value
+ * of the segment after it.
+ *
+ * Only one matrix-sized buffer exists on the host and on the device; the
+ * segments take 20 bytes per SEGMENT elements.
+ *
+ * usage: transpose_inplace [rows [cols [tile [cpu]]]]
+ */
+
+#define DATA_SIZE 4096
+#define TILE 32
+#define TILE_ROWS 8
+#define SEGMENT 1024
+
+const char *KernelSource =                                               "\n"
+  "__kernel void transposeSquare(                                         \n"
+  "   __global float* data,                                               \n"
+  "   const unsigned long n,                                              \n"
+  "   __local float* tileA,                                               \n"
+  "   __local float* tileB)                                               \n"
+  "{                                                                      \n"
+  "   int li = get_local_id(0);                                           \n"
+  "   int lj = get_local_id(1);                                           \n"
+  "   int sz = get_local_size(0);                                         \n"
+  "   int step = get_local_size(1);                                       \n"
+  "   int gi = get_group_id(0);                                           \n"
+  "   int gj = get_group_id(1);                                           \n"
+  "                                                                       \n"
+  "   /* the group of the upper tile swaps both (gi,gj) and (gj,gi) */    \n"
+  "   if( gi < gj)                                                        \n"
+  "     return;                                                           \n"
+  "                                                                       \n"
+  "   /* both tiles are read and written row-wise, i.e. coalesced; the    \n"
+  "    * element offsets are 64 bit, (ra+k)*n wraps in 32 for n > 65535 */\n"
+  "   unsigned long ra = gj*sz+lj, ca = gi*sz+li;                         \n"
+  "   unsigned long rb = gi*sz+lj, cb = gj*sz+li;                         \n"
+  "     for( int k=0; k<sz; k+=step) {                                    \n"
+  "       if( ra+k < n && ca < n)                                         \n"
+  "         tileA[(lj+k)*(sz+1)+li] = data[(ra+k)*n+ca];                  \n"
+  "       if( rb+k < n && cb < n)                                         \n"
+  "         tileB[(lj+k)*(sz+1)+li] = data[(rb+k)*n+cb];                  \n"
+  "     }                                                                 \n"
+  "     barrier( CLK_LOCAL_MEM_FENCE);                                    \n"
+  "     for( int k=0; k<sz; k+=step) {                                    \n"
+  "       if( ra+k < n && ca < n)                                         \n"
+  "         data[(ra+k)*n+ca] = tileB[li*(sz+1)+lj+k];                    \n"
+  "       if( rb+k < n && cb < n)                                         \n"
+  "         data[(rb+k)*n+cb] = tileA[li*(sz+1)+lj+k];                    \n"
+  "     }                                                                 \n"
+  "}                                                                      \n"
+  "                                                                       \n"
+  "/* first value of every segment, before any segment moves */           \n"
+  "__kernel void saveSegments(                                            \n"
+  "   __global const float* data,                                         \n"
+  "   __global const unsigned long* starts,                               \n"
+  "   const unsigned long numSegments,                                    \n"
+  "   __global float* saved)                                              \n"
+  "{                                                                      \n"
+  "   size_t id = get_global_id(0);                                       \n"
+  "   if( id < numSegments)                                               \n"
+  "     saved[id] = data[starts[id]];                                     \n"
+  "}                                                                      \n"
+  "                                                                       \n"
+  "/* rotates one segment of a cycle: the positions from starts[id] up    \n"
+  " * to the one before the next segment's start, whose saved value       \n"
+  " * goes to the last position */                                        \n"
+  "__kernel void transposeCycles(                                         \n"
+  "   __global float* data,                                               \n"
+  "   __global const unsigned long* starts,                               \n"
+  "   __global const unsigned long* nextSegment,                          \n"
+  "   __global const float* saved,                                        \n"
+  "   const unsigned long numSegments,                                    \n"
+  "   const unsigned long rows,                                           \n"
+  "   const unsigned long cols)                                           \n"
+  "{                                                                      \n"
+  "   size_t id = get_global_id(0);                                       \n"
+  "   if( id >= numSegments)                                              \n"
+  "     return;                                                           \n"
+  "                                                                       \n"
+  "   unsigned long next = nextSegment[id];                               \n"
+  "   unsigned long end = starts[next];                                   \n"
+  "   unsigned long cur = starts[id];                                     \n"
+  "     for( ;;) {                                                        \n"
+  "       unsigned long src = (cur%rows)*cols + cur/rows;                 \n"
+  "       if( src == end)                                                 \n"
+  "         break;                                                        \n"
+  "       data[cur] = data[src];                                          \n"
+  "       cur = src;                                                      \n"
+  "     }                                                                 \n"
+  "     data[cur] = saved[next];                                          \n"
+  "}                                                                      \n"
+  "\n";
+
+#define die(msg, ...) do {                      \
+  (void) fprintf (stderr, msg, ## __VA_ARGS__); \
+  (void) fprintf (stderr, "\n");                \
+} while (0)
+
+#define BIT_TEST(v, i) ((v)[(i) >> 3] & (1 << ((i) & 7)))
+#define BIT_SET(v, i)  ((v)[(i) >> 3] |= (1 << ((i) & 7)))
+
+int startsec, startnsec, stopsec, stopnsec;
+
+void printTimeElapsed( char *text)
+{
+  double elapsed = (stopsec -startsec)*1000.0
+                  + (double)(stopnsec -startnsec)/1000000.0;
+  printf( "%s: %f msec\n", text, elapsed);
+}
+
+/* Deterministic, exactly representable value for element (i,j), so the
+ * result can be checked without keeping a copy of the input around.  */
+float valueAt( long i, long j)
+{
+  return (float) ((i*31 + j*17) % 65521);
+}
+
+/* swap the tiles (bi,bj) and (bj,bi) of an n x n matrix on the host */
+void transposeSquareHost( float *a, long n, int tile)
+{
+  for (long bi = 0; bi < n; bi += tile)
+    for (long bj = bi; bj < n; bj += tile)
+      for (long i = bi; i < bi+tile && i < n; i++)
+        for (long j = (bi == bj ? i+1 : bj); j < bj+tile && j < n; j++) {
+          float t = a[i*n+j];
+          a[i*n+j] = a[j*n+i];
+          a[j*n+i] = t;
+        }
+}
+
+/* Walk all cycles of the rows x cols transpose permutation, marking them
+ * in the visited bit vector, and rotate them in a.
+ * Returns the number of cycles of length > 1.  */
+long followCycles( float *a, long rows, long cols, unsigned char *visited)
+{
+  long size = rows*cols;
+  long num = 0;
+
+  /* the first and the last element never move */
+  for (long start = 1; start < size-1; start++) {
+    if (BIT_TEST( visited, start))
+      continue;
+    BIT_SET( visited, start);
+
+    long cur = start;
+    long src = (cur%rows)*cols + cur/rows;
+    if (src == start)
+      continue;
+
+    num++;
+
+    float first = a[start];
+    while (src != start) {
+      a[cur] = a[src];
+      BIT_SET( visited, src);
+      cur = src;
+      src = (cur%rows)*cols + cur/rows;
+    }
+    a[cur] = first;
+  }
+  return num;
+}
+
+/* Walks all cycles once and cuts them into segments of at most seg
+ * positions, in cycle order: starts[k] is the first position of segment k
+ * and next[k] the segment that follows it in its cycle (the cycle's first
+ * segment for its last one). The arrays grow as needed.
+ * Returns the number of segments.  */
+long cycleSegments( long rows, long cols, long seg, unsigned char *visited,
+                    cl_ulong **starts, cl_ulong **next)
+{
+  long size = rows*cols;
+  long num = 0, capacity = 1024;
+
+  *starts = (cl_ulong *) malloc (capacity * sizeof (cl_ulong));
+  *next = (cl_ulong *) malloc (capacity * sizeof (cl_ulong));
+  for (long start = 1; start < size-1; start++) {
+    if (BIT_TEST( visited, start))
+      continue;
+    BIT_SET( visited, start);
+    if ((start%rows)*cols + start/rows == start)
+      continue;
+
+    long first = num;
+    long cur = start;
+    for (long k = 0; ; k++) {
+      if (k % seg == 0) {
+        if (num == capacity) {
+          capacity *= 2;
+          *starts = (cl_ulong *) realloc (*starts, capacity * sizeof (cl_ulong));
+          *next = (cl_ulong *) realloc (*next, capacity * sizeof (cl_ulong));
+        }
+        (*starts)[num] = cur;
+        (*next)[num] = num + 1;
+        num++;
+      }
+      BIT_SET( visited, cur);
+      cur = (cur%rows)*cols + cur/rows;
+      if (cur == start)
+        break;
+    }
+    (*next)[num-1] = first;
+  }
+  return num;
+}
+
+void transposeRectHost( float *a, long rows, long cols)
+{
+  unsigned char *visited = (unsigned char *) calloc ((rows*cols+7)/8, 1);
+
+  followCycles( a, rows, cols, visited);
+  free( visited);
+}
+
+void fillMatrix( float *a, long rows, long cols)
+{
+  for (long i = 0; i < rows; i++)
+    for (long j = 0; j < cols; j++)
+      a[i*cols+j] = valueAt( i, j);
+}
+
+/* a holds the transposed matrix, i.e. cols x rows */
+long checkMatrix( float *a, long rows, long cols)
+{
+  long correct = 0;
+
+  for (long i = 0; i < rows; i++)
+    for (long j = 0; j < cols; j++)
+      if (a[j*rows+i] == valueAt( i, j))
+        correct++;
+  return correct;
+}
+
+void timeDirectImplementation( float *a, long rows, long cols, int tile)
+{
+  TIMERwc_time( &startsec, &startnsec);
+
+  if (rows == cols)
+    transposeSquareHost( a, rows, tile);
+  else
+    transposeRectHost( a, rows, cols);
+
+  TIMERwc_time( &stopsec, &stopnsec);
+
+  printTimeElapsed( "in-place transpose on host");
+}
+
+
+int main (int argc, char * argv[])
+{
+  cl_int err;
+  cl_platform_id platform;
+  cl_device_id device_id;
+  cl_context context;
+  cl_command_queue commands;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem d_data, d_starts = NULL, d_next = NULL, d_saved = NULL;
+  size_t global[2];
+  size_t local[2];
+
+  long rows = (argc > 1 ? atol( argv[1]) : DATA_SIZE);
+  long cols = (argc > 2 ? atol( argv[2]) : rows);
+  int tile = (argc > 3 ? atoi( argv[3]) : TILE);
+  int devType = (argc > 4 ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU);
+  size_t bytes = rows * cols * sizeof (float);
+
+  printf( "in-place transpose of %ld x %ld (%f MB), tile %d\n",
+          rows, cols, bytes/1048576.0, tile);
+  /* the work-group's TILE_ROWS rows step through the tile */
+  if (tile < 1 || (tile > TILE_ROWS && tile % TILE_ROWS != 0)) {
+    die( "Error: the tile must be at most %d or a multiple of it!", TILE_ROWS);
+    return 1;
+  }
+
+  float *data = (float *) malloc (bytes);
+  if (data == NULL) {
+    die( "Error: cannot allocate %lu bytes!", (unsigned long)bytes);
+    return 1;
+  }
+
+  /* host version first, it also doubles as the reference */
+  fillMatrix( data, rows, cols);
+  timeDirectImplementation( data, rows, cols, tile);
+  printf ("Host computed %ld/%ld correct values\n",
+          checkMatrix( data, rows, cols), rows*cols);
+
+  fillMatrix( data, rows, cols);
+
+  TIMERwc_time( &startsec, &startnsec);
+
+  err = clGetPlatformIDs (1, &platform, NULL);
+  err |= clGetDeviceIDs (platform, devType, 1, &device_id, NULL);
+  if (err != CL_SUCCESS) {
+    die( "Error: Failed to find a device!");
+    return 1;
+  }
+  context = clCreateContext (0, 1, &device_id, NULL, NULL, &err);
+  commands = clCreateCommandQueue (context, device_id, 0, &err);
+  program = clCreateProgramWithSource (context, 1, &KernelSource, NULL, &err);
+  err = clBuildProgram (program, 0, NULL, NULL, NULL, NULL);
+  if (err != CL_SUCCESS) {
+    size_t len;
+    char buffer[2048];
+
+    clGetProgramBuildInfo (program, device_id, CL_PROGRAM_BUILD_LOG,
+                           sizeof (buffer), buffer, &len);
+    die ("Error: Failed to build program executable!\n%s", buffer);
+    return 1;
+  }
+
+  /* the matrix is the only data-sized buffer on the device */
+  d_data = clCreateBuffer (context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+  if (err != CL_SUCCESS) {
+    die( "Error: Failed to allocate device memory!");
+    return 1;
+  }
+  err = clEnqueueWriteBuffer (commands, d_data, CL_TRUE, 0, bytes, data, 0, NULL, NULL);
+
+  if (rows == cols) {
+    cl_ulong n = rows;
+
+    kernel = clCreateKernel (program, "transposeSquare", &err);
+    err |= clSetKernelArg (kernel, 0, sizeof (cl_mem), &d_data);
+    err |= clSetKernelArg (kernel, 1, sizeof (cl_ulong), &n);
+    err |= clSetKernelArg (kernel, 2, tile*(tile+1)*sizeof (float), NULL);
+    err |= clSetKernelArg (kernel, 3, tile*(tile+1)*sizeof (float), NULL);
+
+    local[0] = tile;
+    local[1] = (tile < TILE_ROWS ? tile : TILE_ROWS);
+    {
+      size_t maxGroup;
+      cl_ulong localMem;
+
+      clGetKernelWorkGroupInfo (kernel, device_id, CL_KERNEL_WORK_GROUP_SIZE,
+                                sizeof (size_t), &maxGroup, NULL);
+      clGetDeviceInfo (device_id, CL_DEVICE_LOCAL_MEM_SIZE, sizeof (cl_ulong), &localMem, NULL);
+      if (local[0] * local[1] > maxGroup || 2 * tile*(tile+1)*sizeof (float) > localMem) {
+        die( "Error: tile %d needs %lu work-items and %lu bytes of local memory, the device has %lu and %lu!",
+             tile, (unsigned long)(local[0] * local[1]), (unsigned long)(2 * tile*(tile+1)*sizeof (float)),
+             (unsigned long)maxGroup, (unsigned long)localMem);
+        return 1;
+      }
+    }
+    global[0] = (n + tile - 1) / tile * local[0];
+    global[1] = (n + tile - 1) / tile * local[1];
+
+    TIMERwc_time( &stopsec, &stopnsec);
+    printTimeElapsed( "setup time on host (wallclock)");
+
+    TIMERwc_time( &startsec, &startnsec);
+    err |= clEnqueueNDRangeKernel (commands, kernel, 2, NULL, global, local, 0, NULL, NULL);
+  } else {
+    unsigned char *visited = (unsigned char *) calloc ((rows*cols+7)/8, 1);
+    cl_ulong ul_rows = rows, ul_cols = cols;
+    cl_ulong *starts, *next;
+    cl_kernel save;
+
+    /* one walk over the cycles, cut into segments */
+    cl_ulong numSegments = cycleSegments( rows, cols, SEGMENT, visited, &starts, &next);
+    free( visited);
+    printf( "%lu cycle segments\n", (unsigned long)numSegments);
+
+    d_starts = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                               (numSegments+1) * sizeof (cl_ulong), starts, &err);
+    d_next = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                             (numSegments+1) * sizeof (cl_ulong), next, &err);
+    d_saved = clCreateBuffer (context, CL_MEM_READ_WRITE,
+                              (numSegments+1) * sizeof (float), NULL, &err);
+    free( starts);
+    free( next);
+
+    save = clCreateKernel (program, "saveSegments", &err);
+    err |= clSetKernelArg (save, 0, sizeof (cl_mem), &d_data);
+    err |= clSetKernelArg (save, 1, sizeof (cl_mem), &d_starts);
+    err |= clSetKernelArg (save, 2, sizeof (cl_ulong), &numSegments);
+    err |= clSetKernelArg (save, 3, sizeof (cl_mem), &d_saved);
+
+    kernel = clCreateKernel (program, "transposeCycles", &err);
+    err |= clSetKernelArg (kernel, 0, sizeof (cl_mem), &d_data);
+    err |= clSetKernelArg (kernel, 1, sizeof (cl_mem), &d_starts);
+    err |= clSetKernelArg (kernel, 2, sizeof (cl_mem), &d_next);
+    err |= clSetKernelArg (kernel, 3, sizeof (cl_mem), &d_saved);
+    err |= clSetKernelArg (kernel, 4, sizeof (cl_ulong), &numSegments);
+    err |= clSetKernelArg (kernel, 5, sizeof (cl_ulong), &ul_rows);
+    err |= clSetKernelArg (kernel, 6, sizeof (cl_ulong), &ul_cols);
+
+    local[0] = 64;
+    global[0] = (numSegments + local[0] - 1) / local[0] * local[0];
+
+    TIMERwc_time( &stopsec, &stopnsec);
+    printTimeElapsed( "setup time on host (wallclock)");
+
+    TIMERwc_time( &startsec, &startnsec);
+    /* in order: every segment is saved before any moves */
+    if (global[0] > 0) {
+      err |= clEnqueueNDRangeKernel (commands, save, 1, NULL, global, local, 0, NULL, NULL);
+      err |= clEnqueueNDRangeKernel (commands, kernel, 1, NULL, global, local, 0, NULL, NULL);
+    }
+    clReleaseKernel (save);
+  }
+  if (err != CL_SUCCESS)
+    die( "Error: Failed to execute kernel!");
+  clFinish (commands);
+
+  TIMERwc_time( &stopsec, &stopnsec);
+  printTimeElapsed( "in-place transpose on device");
+
+  err = clEnqueueReadBuffer (commands, d_data, CL_TRUE, 0, bytes, data, 0, NULL, NULL);
+
+  printf ("Device computed %ld/%ld correct values\n",
+          checkMatrix( data, rows, cols), rows*cols);
+
+  clReleaseMemObject (d_data);
+  if (d_starts != NULL) {
+    clReleaseMemObject (d_starts);
+    clReleaseMemObject (d_next);
+    clReleaseMemObject (d_saved);
+  }
+  clReleaseKernel (kernel);
+  clReleaseProgram (program);
+  clReleaseCommandQueue (commands);
+  clReleaseContext (context);
+  free( data);
+
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "trdevice.h"
+#include "totient.h"
+
+#define TRDEVICE_LOCAL 64
+#define TRDEVICE_GROUPS_PER_UNIT 16
+
+static cl_context context = NULL;
+static cl_device_id device = NULL;
+static cl_command_queue queue = NULL;
+static cl_program program = NULL;
+static cl_kernel kernel = NULL;
+static cl_uint compute_units = 1;
+
+static cl_mem primes = NULL;
+static cl_uint nprimes = 0;
+static long primes_limit = 0;
+static cl_mem partials = NULL;
+static size_t max_groups = 0;
+
+void trDeviceSetDevice( cl_context ctx, cl_device_id dev, cl_command_queue q)
+{
+  if (ctx != context || dev != device)
+    trDeviceRelease();
+  context = ctx;
+  device = dev;
+  queue = q;
+
+  compute_units = 1;
+  clGetDeviceInfo (dev, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof (cl_uint), &compute_units, NULL);
+  if (compute_units == 0)
+    compute_units = 1;
+}
+
+static cl_int buildKernel( void)
+{
+  FILE *file = fopen( TRDEVICE_KERNEL_FILE, "r");
+  char *source;
+  long len;
+  cl_int err;
+
+  if (file == NULL) {
+    fprintf( stderr, "Error: No file named %s was found\n", TRDEVICE_KERNEL_FILE);
+    return CL_INVALID_PROGRAM;
+  }
+  fseek( file, 0, SEEK_END);
+  len = ftell( file);
+  fseek( file, 0, SEEK_SET);
+  source = (char *) malloc (len + 1);
+  len = fread( source, 1, len, file);
+  source[len] = '\0';
+  fclose( file);
+
+  program = clCreateProgramWithSource (context, 1, (const char **) &source, NULL, &err);
+  free( source);
+  if (err != CL_SUCCESS)
+    return err;
+  err = clBuildProgram (program, 1, &device, NULL, NULL, NULL);
+  if (err != CL_SUCCESS) {
+    char buffer[2048];
+
+    clGetProgramBuildInfo (program, device, CL_PROGRAM_BUILD_LOG, sizeof (buffer), buffer, NULL);
+    fprintf( stderr, "Error: Failed to build %s!\n%s\n", TRDEVICE_KERNEL_FILE, buffer);
+    clReleaseProgram (program);
+    program = NULL;
+    return err;
+  }
+  kernel = clCreateKernel (program, "calculateTR", &err);
+  return err;
+}
+
+/* primes up to at least sqrt(upper) on the device */
+static cl_int uploadPrimes( long upper)
+{
+  long limit = (long) sqrtl( (long double) upper) + 1;
+  long count;
+  long *p;
+  cl_uint *p32;
+  cl_int err;
+
+  if (primes != NULL && limit <= primes_limit)
+    return CL_SUCCESS;
+  /* some headroom, so growing ranges do not upload every time */
+  limit *= 2;
+  p = totientPrimes( limit, &count);
+  p32 = (cl_uint *) malloc ((count + 1) * sizeof (cl_uint));
+  for (long i = 0; i < count; i++)
+    p32[i] = (cl_uint) p[i];
+  free( p);
+
+  if (primes != NULL)
+    clReleaseMemObject (primes);
+  primes = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                           (count + 1) * sizeof (cl_uint), p32, &err);
+  free( p32);
+  if (err != CL_SUCCESS) {
+    primes = NULL;
+    return err;
+  }
+  nprimes = (cl_uint) count;
+  primes_limit = limit;
+  return CL_SUCCESS;
+}
+
+cl_int trDeviceSum( long lower, long upper, __int128 *sum)
+{
+  size_t local = TRDEVICE_LOCAL, groups, global, max_local;
+  cl_ulong lo, hi;
+  cl_ulong *sums;
+  cl_int err = CL_SUCCESS;
+
+  *sum = 0;
+  if (lower < 0)
+    lower = 0;
+  if (upper < lower)
+    return CL_SUCCESS;
+  if (kernel == NULL && (err = buildKernel()) != CL_SUCCESS)
+    return err;
+  if ((err = uploadPrimes( upper)) != CL_SUCCESS)
+    return err;
+
+  if (clGetKernelWorkGroupInfo (kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                sizeof (size_t), &max_local, NULL) == CL_SUCCESS
+      && local > max_local)
+    local = max_local;
+  groups = compute_units * TRDEVICE_GROUPS_PER_UNIT;
+  if (groups > (size_t)(upper - lower) / local + 1)
+    groups = (size_t)(upper - lower) / local + 1;
+  global = groups * local;
+  if (groups > max_groups) {
+    if (partials != NULL)
+      clReleaseMemObject (partials);
+    partials = clCreateBuffer (context, CL_MEM_WRITE_ONLY, groups * sizeof (cl_ulong), NULL, &err);
+    if (err != CL_SUCCESS) {
+      partials = NULL;
+      max_groups = 0;
+      return err;
+    }
+    max_groups = groups;
+  }
+
+  lo = lower;
+  hi = upper;
+  err = clSetKernelArg (kernel, 0, sizeof (cl_ulong), &lo);
+  err |= clSetKernelArg (kernel, 1, sizeof (cl_ulong), &hi);
+  err |= clSetKernelArg (kernel, 2, sizeof (cl_mem), &primes);
+  err |= clSetKernelArg (kernel, 3, sizeof (cl_uint), &nprimes);
+  err |= clSetKernelArg (kernel, 4, sizeof (cl_mem), &partials);
+  err |= clSetKernelArg (kernel, 5, local * sizeof (cl_ulong), NULL);
+  if (err != CL_SUCCESS)
+    return err;
+
+  sums = (cl_ulong *) malloc (groups * sizeof (cl_ulong));
+  err = clEnqueueNDRangeKernel (queue, kernel, 1, NULL, &global, &local, 0, NULL, NULL);
+  if (err == CL_SUCCESS)
+    err = clEnqueueReadBuffer (queue, partials, CL_TRUE, 0, groups * sizeof (cl_ulong), sums, 0, NULL, NULL);
+  if (err == CL_SUCCESS)
+    for (size_t g = 0; g < groups; g++)
+      *sum += sums[g];
+  free( sums);
+  return err;
+}
+
+void trDeviceRelease( void)
+{
+  if (kernel != NULL)
+    clReleaseKernel (kernel);
+  if (program != NULL)
+    clReleaseProgram (program);
+  if (primes != NULL)
+    clReleaseMemObject (primes);
+  if (partials != NULL)
+    clReleaseMemObject (partials);
+  kernel = NULL;
+  program = NULL;
+  primes = NULL;
+  partials = NULL;
+  nprimes = 0;
+  primes_limit = 0;
+  max_groups = 0;
+}
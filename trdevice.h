@@ -0,0 +1,30 @@
+#ifndef TRDEVICE_H
+#define TRDEVICE_H
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+/* Sums of euler(n) over ranges on an OpenCL device with calculateTR from
+ * trKernel.cl (read from TRDEVICE_KERNEL_FILE when first needed). The
+ * primes up to sqrt(upper) are sieved on the host and kept on the device
+ * until a larger upper needs more; one launch of a few work-groups per
+ * compute unit covers any range, and only the per-group 64-bit sums come
+ * back, added up in 128 bit.
+ */
+
+#ifndef TRDEVICE_KERNEL_FILE
+#define TRDEVICE_KERNEL_FILE "trKernel.cl"
+#endif
+
+void trDeviceSetDevice( cl_context context, cl_device_id device, cl_command_queue queue);
+
+/* *sum = euler(lower) + ... + euler(upper); blocks until it is known */
+cl_int trDeviceSum( long lower, long upper, __int128 *sum);
+
+/* releases the program and the buffers */
+void trDeviceRelease( void);
+
+#endif
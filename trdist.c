@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <omp.h>
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "totient.h"
+#include "trdevice.h"
+
+/* Sum of the totients between lower and upper, split over worker
+ * processes by a coordinator.
+ *
+ * The coordinator forks the workers, each connected by a Unix-domain
+ * socket pair, and hands out chunks of the range one at a time: a worker
+ * gets its next chunk when it returns a result. A worker that dies (its
+ * socket closes) loses its chunk back to the queue. Once the queue is
+ * empty, idle workers also take a second copy of any chunk that has been
+ * running STRAGGLER_FACTOR times longer than the mean chunk, and the
+ * first result to arrive counts, so a slow worker does not hold up the
+ * end. Results are 128-bit partial sums.
+ *
+ * Workers sieve their chunks with the OpenMP threads (totientSieveSum),
+ * the cores shared out between them; with gpu or cpu worker 0 drives that
+ * OpenCL device instead (trdevice.c), falling back to the host if there
+ * is none. The total is checked against the sub-linear Phi(upper) -
+ * Phi(lower-1).
+ *
+ * usage: trdist lower upper [workers [chunk [host|gpu|cpu]]]
+ */
+
+#define die(msg, ...) do {                      \
+  (void) fprintf (stderr, msg, ## __VA_ARGS__); \
+  (void) fprintf (stderr, "\n");                \
+} while (0)
+
+#define STRAGGLER_FACTOR 3.0
+#define POLL_MSEC 100
+
+typedef struct {
+  int64_t id;                   /* < 0: stop */
+  int64_t lower, upper;
+} chunk_msg;
+
+typedef struct {
+  int64_t id;
+  uint64_t lo, hi;              /* the 128-bit sum */
+  double seconds;
+} result_msg;
+
+typedef enum { CHUNK_PENDING, CHUNK_RUNNING, CHUNK_DONE } chunk_state;
+
+typedef struct {
+  long lower, upper;
+  chunk_state state;
+  int copies;                   /* workers running it */
+  double issued;
+} chunk;
+
+typedef struct {
+  pid_t pid;
+  int fd;
+  int alive;
+  long chunk;                   /* running, or -1 */
+} worker;
+
+static int readFull( int fd, void *buf, size_t n)
+{
+  char *p = (char *) buf;
+
+  while (n > 0) {
+    ssize_t r = read( fd, p, n);
+
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return -1;
+    p += r;
+    n -= r;
+  }
+  return 0;
+}
+
+static int writeFull( int fd, const void *buf, size_t n)
+{
+  const char *p = (const char *) buf;
+
+  while (n > 0) {
+    ssize_t r = write( fd, p, n);
+
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return -1;
+    p += r;
+    n -= r;
+  }
+  return 0;
+}
+
+/* a worker process: chunks in, sums out, until told to stop */
+static void runWorker( int fd, int index, int threads, cl_device_type devType)
+{
+  cl_context context = NULL;
+  cl_command_queue commands = NULL;
+  int useDevice = 0;
+  chunk_msg c;
+
+  omp_set_num_threads( threads);
+  if (devType != 0) {
+    cl_platform_id platform;
+    cl_device_id device_id;
+    cl_int err;
+
+    err = clGetPlatformIDs (1, &platform, NULL);
+    err |= clGetDeviceIDs (platform, devType, 1, &device_id, NULL);
+    if (err == CL_SUCCESS) {
+      context = clCreateContext (0, 1, &device_id, NULL, NULL, &err);
+      commands = clCreateCommandQueue (context, device_id, 0, &err);
+      trDeviceSetDevice( context, device_id, commands);
+      useDevice = 1;
+    } else {
+      die( "worker %d: no device, using the host", index);
+    }
+  }
+
+  while (readFull( fd, &c, sizeof (c)) == 0 && c.id >= 0) {
+    double start = omp_get_wtime();
+    __int128 sum = 0;
+    result_msg r;
+
+    if (!useDevice || trDeviceSum( c.lower, c.upper, &sum) != CL_SUCCESS) {
+      useDevice = 0;
+      sum = totientSieveSum( c.lower, c.upper);
+    }
+    r.id = c.id;
+    r.lo = (uint64_t) sum;
+    r.hi = (uint64_t)(sum >> 64);
+    r.seconds = omp_get_wtime() - start;
+    if (writeFull( fd, &r, sizeof (r)) != 0)
+      break;
+  }
+
+  if (useDevice) {
+    trDeviceRelease();
+    clReleaseCommandQueue (commands);
+    clReleaseContext (context);
+  }
+  close( fd);
+}
+
+static void workerLost( worker *w, int k, chunk *chunks)
+{
+  w->alive = 0;
+  close( w->fd);
+  waitpid( w->pid, NULL, 0);
+  if (w->chunk >= 0) {
+    chunk *c = &chunks[w->chunk];
+
+    c->copies--;
+    if (c->state != CHUNK_DONE && c->copies == 0) {
+      c->state = CHUNK_PENDING;
+      printf( "worker %d lost, chunk %ld [%ld..%ld] back in the queue\n",
+              k, w->chunk, c->lower, c->upper);
+    }
+  }
+  w->chunk = -1;
+}
+
+int main (int argc, char * argv[])
+{
+  long lower, upper, chunkSize, nchunks, done = 0;
+  int nworkers = (argc > 3 ? atoi( argv[3]) : 4);
+  const char *kind = (argc > 5 ? argv[5] : "host");
+  cl_device_type devType = (strcmp( kind, "gpu") == 0 ? CL_DEVICE_TYPE_GPU
+                            : strcmp( kind, "cpu") == 0 ? CL_DEVICE_TYPE_CPU : 0);
+  long cores = sysconf( _SC_NPROCESSORS_ONLN);
+  double meanTime = 0.0, start;
+  long finished = 0, reissued = 0;
+  __int128 sum = 0, expected;
+  char digits[48], expectedDigits[48];
+  chunk *chunks;
+  worker *workers;
+  int alive;
+
+  if (argc < 3) {
+    die( "usage: trdist lower upper [workers [chunk [host|gpu|cpu]]]");
+    return 1;
+  }
+  lower = atol( argv[1]);
+  upper = atol( argv[2]);
+  if (lower < 0)
+    lower = 0;
+  if (upper < lower || nworkers < 1) {
+    die( "Error: empty range or no workers!");
+    return 1;
+  }
+  chunkSize = (argc > 4 ? atol( argv[4]) : (upper - lower + 1) / (16 * nworkers));
+  if (chunkSize < 1)
+    chunkSize = 1;
+  nchunks = (upper - lower) / chunkSize + 1;
+
+  chunks = (chunk *) calloc (nchunks, sizeof (chunk));
+  for (long i = 0; i < nchunks; i++) {
+    chunks[i].lower = lower + i * chunkSize;
+    chunks[i].upper = (upper - chunks[i].lower < chunkSize ? upper : chunks[i].lower + chunkSize - 1);
+  }
+
+  /* a dead worker's socket must not kill the coordinator */
+  signal( SIGPIPE, SIG_IGN);
+  workers = (worker *) calloc (nworkers, sizeof (worker));
+  for (int k = 0; k < nworkers; k++) {
+    int sv[2];
+
+    if (socketpair( AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+      perror( "socketpair");
+      return 1;
+    }
+    workers[k].pid = fork();
+    if (workers[k].pid == 0) {
+      /* the child keeps only its own end */
+      for (int j = 0; j < k; j++)
+        close( workers[j].fd);
+      close( sv[0]);
+      runWorker( sv[1], k, (int)(cores / nworkers > 1 ? cores / nworkers : 1),
+                 k == 0 ? devType : 0);
+      _exit( 0);
+    }
+    close( sv[1]);
+    if (workers[k].pid < 0) {
+      perror( "fork");
+      return 1;
+    }
+    workers[k].fd = sv[0];
+    workers[k].alive = 1;
+    workers[k].chunk = -1;
+  }
+  printf( "[%ld..%ld]: %ld chunks of %ld over %d workers (%s)\n",
+          lower, upper, nchunks, chunkSize, nworkers, kind);
+
+  start = omp_get_wtime();
+  alive = nworkers;
+  while (done < nchunks && alive > 0) {
+    struct pollfd *fds = (struct pollfd *) calloc (nworkers, sizeof (struct pollfd));
+    double now = omp_get_wtime();
+    long next = 0;
+
+    /* hand out work to the idle workers */
+    for (int k = 0; k < nworkers; k++) {
+      worker *w = &workers[k];
+      long pick = -1;
+
+      if (!w->alive || w->chunk >= 0)
+        continue;
+      while (next < nchunks && chunks[next].state != CHUNK_PENDING)
+        next++;
+      if (next < nchunks) {
+        pick = next;
+      } else if (finished > 0) {
+        /* nothing queued: back up the slowest straggler */
+        double oldest = STRAGGLER_FACTOR * meanTime;
+
+        for (long i = 0; i < nchunks; i++)
+          if (chunks[i].state == CHUNK_RUNNING && chunks[i].copies == 1
+              && now - chunks[i].issued > oldest) {
+            oldest = now - chunks[i].issued;
+            pick = i;
+          }
+        if (pick >= 0) {
+          reissued++;
+          printf( "chunk %ld running for %.2f s, issued again to worker %d\n", pick, oldest, k);
+        }
+      }
+      if (pick < 0)
+        continue;
+
+      chunk_msg m = { pick, chunks[pick].lower, chunks[pick].upper };
+      if (writeFull( w->fd, &m, sizeof (m)) != 0) {
+        workerLost( w, k, chunks);
+        alive--;
+        continue;
+      }
+      if (chunks[pick].state == CHUNK_PENDING)
+        chunks[pick].issued = now;
+      chunks[pick].state = CHUNK_RUNNING;
+      chunks[pick].copies++;
+      w->chunk = pick;
+    }
+
+    for (int k = 0; k < nworkers; k++) {
+      fds[k].fd = (workers[k].alive ? workers[k].fd : -1);
+      fds[k].events = POLLIN;
+    }
+    if (poll( fds, nworkers, POLL_MSEC) < 0 && errno != EINTR) {
+      perror( "poll");
+      return 1;
+    }
+
+    for (int k = 0; k < nworkers; k++) {
+      worker *w = &workers[k];
+      result_msg r;
+
+      if (!w->alive || !(fds[k].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+      if (readFull( w->fd, &r, sizeof (r)) != 0 || r.id != w->chunk) {
+        workerLost( w, k, chunks);
+        alive--;
+        continue;
+      }
+      chunks[r.id].copies--;
+      if (chunks[r.id].state != CHUNK_DONE) {
+        chunks[r.id].state = CHUNK_DONE;
+        sum += ((__int128) r.hi << 64) | r.lo;
+        done++;
+        finished++;
+        meanTime += (r.seconds - meanTime) / finished;
+      }
+      w->chunk = -1;
+    }
+    free( fds);
+  }
+
+  if (done < nchunks) {
+    die( "all workers lost, summing the remaining %ld chunks here", nchunks - done);
+    for (long i = 0; i < nchunks; i++)
+      if (chunks[i].state != CHUNK_DONE)
+        sum += totientSieveSum( chunks[i].lower, chunks[i].upper);
+  }
+  printf( "C: Sum of Totients  between [%ld..%ld] is %s\n", lower, upper, totientFormat( sum, digits));
+  printf( "Execution time: %f (%ld chunks issued twice)\n", omp_get_wtime() - start, reissued);
+
+  /* idle workers are told to stop; a straggler still on a chunk that
+   * another worker finished is not waited for */
+  for (int k = 0; k < nworkers; k++)
+    if (workers[k].alive) {
+      chunk_msg stop = { -1, 0, 0 };
+
+      if (workers[k].chunk >= 0)
+        kill( workers[k].pid, SIGKILL);
+      else
+        writeFull( workers[k].fd, &stop, sizeof (stop));
+      close( workers[k].fd);
+      waitpid( workers[k].pid, NULL, 0);
+    }
+
+  expected = totientSumRange( lower, upper);
+  if (expected == sum)
+    printf( "Matches Phi(upper) - Phi(lower-1)\n");
+  else
+    printf( "Does not match Phi(upper) - Phi(lower-1) = %s!\n", totientFormat( expected, expectedDigits));
+
+  free( chunks);
+  free( workers);
+  return 0;
+}
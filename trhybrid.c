@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "totient.h"
+#include "trdevice.h"
+
+/* Sum of the totients between lower and upper on the host cores and an
+ * OpenCL device at the same time.
+ *
+ * One OpenMP team runs both sides: thread 0 feeds the device through
+ * trdevice.c (calculateTR from trKernel.cl), the others sieve on the
+ * host, each its own chunk. All of them take chunks from the front of one
+ * shared queue. Every taker measures its own rate (numbers per second,
+ * smoothed over its chunks), and a chunk is sized to a fraction
+ * 1/SPLIT of the time the whole team should still need at the combined
+ * rate, so chunks shrink towards the end and both sides run out of work
+ * together; a chunk is never shorter than MIN_CHUNK_SEC of the taker's
+ * own rate, which keeps the launch overhead of the device small. Until
+ * every taker has a rate, chunks are fixed probes.
+ *
+ * usage: trhybrid lower upper [gpu|cpu|none]
+ */
+
+#define die(msg, ...) do {                      \
+  (void) fprintf (stderr, msg, ## __VA_ARGS__); \
+  (void) fprintf (stderr, "\n");                \
+} while (0)
+
+#define SPLIT 4.0
+#define MIN_CHUNK_SEC 0.005
+#define HOST_PROBE (4L * TOTIENT_SEGMENT)
+#define DEVICE_PROBE (1L << 20)
+/* weight of the newest chunk in the smoothed rate */
+#define RATE_WEIGHT 0.5
+
+typedef struct {
+  long next, upper;             /* the queue: [next, upper] */
+  int takers;
+  double *rate;                 /* per taker, 0 until its first chunk */
+} work_queue;
+
+/* takes the next chunk for taker t; 0 when the queue is empty */
+static int takeChunk( work_queue *q, int t, long probe, long *lo, long *hi)
+{
+  int got = 0;
+
+#pragma omp critical (queue)
+  {
+    long remaining = q->upper - q->next + 1;
+
+    if (remaining > 0) {
+      long size = probe;
+      double total = 0.0, seconds;
+      int known = 1;
+
+      for (int k = 0; k < q->takers; k++) {
+        total += q->rate[k];
+        known &= (q->rate[k] > 0.0);
+      }
+      /* probes until every taker has a rate */
+      if (known) {
+        seconds = remaining / total / SPLIT;
+        if (seconds < MIN_CHUNK_SEC)
+          seconds = MIN_CHUNK_SEC;
+        size = (long)(q->rate[t] * seconds);
+      }
+      if (size < 1)
+        size = 1;
+      if (size > remaining)
+        size = remaining;
+      *lo = q->next;
+      *hi = q->next + size - 1;
+      q->next += size;
+      got = 1;
+    }
+  }
+  return got;
+}
+
+static void updateRate( work_queue *q, int t, long count, double seconds)
+{
+  double r = count / (seconds > 1e-9 ? seconds : 1e-9);
+
+#pragma omp critical (queue)
+  q->rate[t] = (q->rate[t] > 0.0 ? RATE_WEIGHT * r + (1.0 - RATE_WEIGHT) * q->rate[t] : r);
+}
+
+int main (int argc, char * argv[])
+{
+  long lower, upper, nprimes;
+  const char *kind = (argc > 3 ? argv[3] : "gpu");
+  cl_device_type devType = (strcmp( kind, "cpu") == 0 ? CL_DEVICE_TYPE_CPU
+                            : strcmp( kind, "none") == 0 ? 0 : CL_DEVICE_TYPE_GPU);
+  cl_context context = NULL;
+  cl_command_queue commands = NULL;
+  int useDevice = 0, hostThreads = omp_get_max_threads();
+  long *primes;
+  long deviceCount = 0, hostCount = 0;
+  double deviceEnd = 0.0, hostEnd = 0.0, start;
+  __int128 sum = 0, expected;
+  char digits[48], expectedDigits[48];
+  work_queue q;
+
+  if (argc < 3) {
+    die( "usage: trhybrid lower upper [gpu|cpu|none]");
+    return 1;
+  }
+  lower = atol( argv[1]);
+  upper = atol( argv[2]);
+  if (lower < 2)
+    lower = 2;
+
+  if (devType != 0) {
+    cl_platform_id platform;
+    cl_device_id device_id;
+    cl_int err;
+
+    err = clGetPlatformIDs (1, &platform, NULL);
+    err |= clGetDeviceIDs (platform, devType, 1, &device_id, NULL);
+    if (err == CL_SUCCESS) {
+      context = clCreateContext (0, 1, &device_id, NULL, NULL, &err);
+      commands = clCreateCommandQueue (context, device_id, 0, &err);
+      trDeviceSetDevice( context, device_id, commands);
+      useDevice = 1;
+    } else {
+      die( "no %s device, host only", kind);
+    }
+  }
+
+  primes = totientPrimes( (long) sqrtl( (long double) (upper > 0 ? upper : 0)) + 1, &nprimes);
+  q.next = lower;
+  q.upper = upper;
+  q.takers = hostThreads + useDevice;
+  q.rate = (double *) calloc (q.takers, sizeof (double));
+
+  start = omp_get_wtime();
+  /* taker 0 is the device feeder when there is a device */
+#pragma omp parallel num_threads(q.takers) reduction(+:sum)
+  {
+    int t = omp_get_thread_num();
+    int feeder = (useDevice && t == 0);
+    unsigned long *phi = NULL, *prod = NULL;
+    long lo, hi, count = 0;
+
+    if (!feeder) {
+      phi = (unsigned long *) malloc (TOTIENT_SEGMENT * sizeof (unsigned long));
+      prod = (unsigned long *) malloc (TOTIENT_SEGMENT * sizeof (unsigned long));
+    }
+    while (takeChunk( &q, t, feeder ? DEVICE_PROBE : HOST_PROBE, &lo, &hi)) {
+      double t0 = omp_get_wtime();
+      __int128 part = 0;
+
+      if (feeder && trDeviceSum( lo, hi, &part) != CL_SUCCESS) {
+        die( "device failed, chunk [%ld..%ld] on the host", lo, hi);
+        feeder = 0;
+        phi = (unsigned long *) malloc (TOTIENT_SEGMENT * sizeof (unsigned long));
+        prod = (unsigned long *) malloc (TOTIENT_SEGMENT * sizeof (unsigned long));
+      }
+      if (!feeder) {
+        part = 0;
+        for (long s = lo; s <= hi; s += TOTIENT_SEGMENT) {
+          long e = (hi - s < TOTIENT_SEGMENT ? hi + 1 : s + TOTIENT_SEGMENT);
+          unsigned long segment = 0;
+
+          totientSieveSegment( s, e, primes, nprimes, phi, prod);
+          for (long k = 0; k < e - s; k++)
+            segment += phi[k];
+          part += segment;
+        }
+      }
+      sum += part;
+      count += hi - lo + 1;
+      updateRate( &q, t, hi - lo + 1, omp_get_wtime() - t0);
+    }
+
+#pragma omp critical (stats)
+    {
+      double end = omp_get_wtime() - start;
+
+      if (useDevice && t == 0) {
+        deviceCount = count;
+        deviceEnd = end;
+      } else {
+        hostCount += count;
+        if (end > hostEnd)
+          hostEnd = end;
+      }
+    }
+    free( phi);
+    free( prod);
+  }
+
+  printf( "C: Sum of Totients  between [%ld..%ld] is %s\n", lower, upper, totientFormat( sum, digits));
+  printf( "Execution time: %f\n", omp_get_wtime() - start);
+  printf( "host:   %d threads, %ld numbers (%.1f%%), done after %f s\n", hostThreads, hostCount,
+          100.0 * hostCount / (double)(hostCount + deviceCount > 0 ? hostCount + deviceCount : 1), hostEnd);
+  if (useDevice)
+    printf( "device: %ld numbers (%.1f%%), done after %f s\n", deviceCount,
+            100.0 * deviceCount / (double)(hostCount + deviceCount > 0 ? hostCount + deviceCount : 1), deviceEnd);
+
+  expected = totientSumRange( lower, upper);
+  if (expected == sum)
+    printf( "Matches Phi(upper) - Phi(lower-1)\n");
+  else
+    printf( "Does not match Phi(upper) - Phi(lower-1) = %s!\n", totientFormat( expected, expectedDigits));
+
+  if (useDevice) {
+    trDeviceRelease();
+    clReleaseCommandQueue (commands);
+    clReleaseContext (context);
+  }
+  free( primes);
+  free( q.rate);
+  return 0;
+}
@@ -2,7 +2,16 @@
 //
 // TotientRance.c - Sequential Euler Totient Function (C Version)
 // compile: gcc -Wall -O -o TotientRange TotientRange.c
-// run:     ./TotientRange lower_num uppper_num
+// run:     ./TotientRange lower_num uppper_num [naive|sieve|phi|cache [file]]
+//          ./TotientRange lower_num uppper_num scaling [naive|sieve|phi [repeats [csv]]]
+//          ./TotientRange lower_num uppper_num benchmark
+//          sieve (the default) splits the segments of the sieve in
+//          totient.c over the threads, naive the values of euler(),
+//          phi the sub-linear Phi(upper) - Phi(lower-1), cache the
+//          prefix sums kept in file (totient.cache) by totcache.c;
+//          scaling runs the strong and weak scaling study in
+//          runScaling() (default sieve, 3 repeats, scaling.csv),
+//          benchmark times single euler(n) calls
 
 // Greg Michaelson 14/10/2003
 // Patrick Maier   29/01/2010 [enforced ANSI C compliance]
@@ -12,22 +21,23 @@
 // Phil Trinder, Nathan Charles, Hans-Wolfgang Loidl and Colin Runciman
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
+#include <string.h>
 #include <omp.h>
 
+#include "totient.h"
+#include "totcache.h"
+
 // hcf x 0 = x
 // hcf x y = hcf y (rem x y)
+//
+// computed with Stein's binary gcd (totientGcd in totient.c): shifts by
+// the trailing zero count instead of 64 bit divisions
 
 long hcf(long x, long y)
 {
-  long t;
-
-  while (y != 0) {
-    t = x % y;
-    x = y;
-    y = t;
-  }
-  return x;
+  return (long) totientGcd(x, y);
 }
 
 
@@ -40,73 +50,204 @@ int relprime(long x, long y)
 
 
 // euler n = length (filter (relprime n) [1 .. n-1])
+//
+// totientEulerGcd tests 16 (AVX-512) or 8 (AVX2) values of i at once
+// with the binary gcd, chosen at runtime; otherwise a scalar loop
 
 long euler(long n)
 {
-  long length, i;
-
-  length = 0;
-  for (i = 1; i < n; i++)
-    if (relprime(n, i))
-      length++;
-
-  return length;
+  return totientEulerGcd(n);
 }
 
 
 // sumTotient lower upper = sum (map euler [lower, lower+1 .. upper])
 // F21DP CW1 OpenMP parallelism implementation by Daya Natarajan
-long sumTotient(long lower, long upper)
-{
-  long sum[100000], total;
-  int i,num_t; 	
+//
+// euler(n) costs O(n log n), so the loop runs from upper down: the
+// most expensive values are handed out first and the cheap ones at the
+// end fill the gaps. Threads take CHUNK values at a time and keep their
+// own sum, added up by the reduction.
+
+#define CHUNK 16
 
-#pragma omp parallel
+long sumTotient(long lower, long upper)
 {
-  	int i, id, num_threads;
-	id = omp_get_thread_num();
-	num_threads = omp_get_num_threads();
-	printf("No of threads within parallel :%d and thread no:%d \n",num_threads,id);
+  long total = 0;
+  long i;
 
-	if(id==0)
-    		num_t = num_threads;
+#pragma omp parallel for schedule(dynamic, CHUNK) reduction(+:total)
+  for (i = upper; i >= lower; i--)
+    total += euler(i);
 
-  	sum[id] = 0;
- 	for(i=id+lower; i<upper; i+=num_threads) {
-  		sum[id] += euler(i);
-	}
+  return total;
+}
 
 
-}
+// sumTotient from the persistent prefix sums, extending them as needed
 
-	total=0;
-	for (i=0;i<num_t;i++)
-		total+=sum[i];
+__int128 cachedSumTotient(long lower, long upper, const char *path)
+{
+  totcache c;
+  __int128 sum;
 
-  return total;
+  if (totcacheOpen(path, 0, &c) != 0) {
+    perror(path);
+    return totientSieveSum(lower, upper);
+  }
+  printf("cache %s: block %ld, %ld checkpoints\n", path, c.block, c.count);
+  sum = totcacheRange(&c, lower, upper);
+  totcacheClose(&c);
+  return sum;
 }
 
 
+// time of single euler(n) calls, wall-clock
+
 void runBenchmark()
 {
-  clock_t start, end;
-  double time_taken;
+  double start, end;
 
   for (long i = 1; i < 1000000 ; i = i + 100000) {
-    start = clock();
+    start = omp_get_wtime();
     euler(i);
-    end = clock();
-    time_taken = ((double) (end - start)) / CLOCKS_PER_SEC;
-    printf("euler(%lu) = %f seconds\n", i, time_taken);
+    end = omp_get_wtime();
+    printf("euler(%lu) = %f seconds\n", i, end - start);
   }   
 }
 
+
+// Scaling study over every thread count p = 1, 2, 4, ...,
+// omp_get_max_threads(), each point the best of repeats runs of the method.
+//
+// Strong scaling: the range [lower, upper] and ranges of a quarter and a
+// sixteenth of its length (from lower), fixed while p grows. With T1 the
+// best time on one thread and Tp on p threads:
+//   speedup S = T1/Tp, efficiency S/p,
+//   Karp-Flatt serial fraction e = (1/S - 1/p) / (1 - 1/p)
+// An e that grows with p points to overhead (scheduling, imbalance), a
+// constant e to a serial part.
+//
+// Weak scaling: the range grows with p, [lower, lower + p*len - 1] with
+// len = (upper - lower + 1) / max threads, so the largest run covers
+// [lower, upper]. With T1 the time for len numbers on one thread:
+//   scaled efficiency E = T1/Tp, scaled (Gustafson) speedup p*E
+// E stays near 100% while the per-thread work is the same; the sieve's
+// cost per number is almost flat, but a naive euler(n) costs more for the
+// larger n, which lowers E without any parallel overhead.
+//
+// Times are wall-clock (omp_get_wtime); a table goes to stdout and one
+// line per point to csv.
+
+#define MAX_THREAD_COUNTS 32
+
+__int128 runMethod(const char *method, long lower, long upper)
+{
+  if (strcmp(method, "naive") == 0)
+    return sumTotient(lower, upper);
+  if (strcmp(method, "phi") == 0)
+    return totientSumRange(lower, upper);
+  return totientSieveSum(lower, upper);
+}
+
+// best and mean of repeats runs on p threads
+void timeMethod(const char *method, long lower, long upper, int p, int repeats,
+                double *best, double *mean)
+{
+  double total = 0.0;
+
+  omp_set_num_threads(p);
+  for (int r = 0; r < repeats; r++) {
+    double start = omp_get_wtime();
+    runMethod(method, lower, upper);
+    double time = omp_get_wtime() - start;
+
+    total += time;
+    if (r == 0 || time < *best)
+      *best = time;
+  }
+  *mean = total / repeats;
+}
+
+void runScaling(long lower, long upper, const char *method, int repeats, const char *csv)
+{
+  int maxThreads = omp_get_max_threads();
+  int threads[MAX_THREAD_COUNTS], counts = 0;
+  long len = (upper - lower + 1) / maxThreads;
+  FILE *out = fopen(csv, "w");
+
+  if (out == NULL) {
+    perror(csv);
+    return;
+  }
+  if (repeats < 1)
+    repeats = 1;
+  for (int t = 1; counts < MAX_THREAD_COUNTS; t *= 2) {
+    threads[counts++] = (t < maxThreads ? t : maxThreads);
+    if (t >= maxThreads)
+      break;
+  }
+
+  fprintf(out, "study,method,lower,upper,threads,repeats,best_s,mean_s,speedup,efficiency,karp_flatt\n");
+  printf("%-6s %-6s %14s %8s %12s %12s %9s %11s %11s\n", "study", "method", "size", "threads",
+         "best [s]", "mean [s]", "speedup", "efficiency", "karp-flatt");
+  for (long div = 1; div <= 16; div *= 4) {
+    long hi = lower + (upper - lower + 1) / div - 1;
+    double base = 0.0;
+
+    if (hi < lower)
+      break;
+    for (int c = 0; c < counts; c++) {
+      int p = threads[c];
+      double best, mean;
+
+      timeMethod(method, lower, hi, p, repeats, &best, &mean);
+      if (p == 1)
+        base = best;
+
+      double speedup = base / best;
+      double efficiency = speedup / p;
+      double karpFlatt = (p > 1 ? (1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p) : 0.0);
+
+      printf("%-6s %-6s %14ld %8d %12.6f %12.6f %9.2f %10.1f%% %11.4f\n", "strong", method,
+             hi - lower + 1, p, best, mean, speedup, 100.0 * efficiency, karpFlatt);
+      fprintf(out, "strong,%s,%ld,%ld,%d,%d,%.9f,%.9f,%.4f,%.4f,%.6f\n", method, lower, hi, p,
+              repeats, best, mean, speedup, efficiency, karpFlatt);
+    }
+  }
+
+  if (len >= 1) {
+    double base = 0.0;
+
+    for (int c = 0; c < counts; c++) {
+      int p = threads[c];
+      long hi = lower + p * len - 1;
+      double best, mean;
+
+      timeMethod(method, lower, hi, p, repeats, &best, &mean);
+      if (p == 1)
+        base = best;
+
+      double efficiency = base / best;
+
+      printf("%-6s %-6s %14ld %8d %12.6f %12.6f %9.2f %10.1f%% %11s\n", "weak", method,
+             hi - lower + 1, p, best, mean, p * efficiency, 100.0 * efficiency, "-");
+      fprintf(out, "weak,%s,%ld,%ld,%d,%d,%.9f,%.9f,%.4f,%.4f,\n", method, lower, hi, p,
+              repeats, best, mean, p * efficiency, efficiency);
+    }
+  }
+  omp_set_num_threads(maxThreads);
+  fclose(out);
+  printf("results written to %s\n", csv);
+}
+
 int main(int argc, char ** argv)
 {
   long lower, upper;
+  const char *mode;
+  char digits[48];
 
-  if (argc != 3) {
-    printf("not 2 arguments\n");
+  if (argc < 3 || argc > 7) {
+    printf("not 2 to 6 arguments\n");
     return 1;
   }
 //  int tnum = atoi(argv[3]);	
@@ -114,19 +255,39 @@ int main(int argc, char ** argv)
 
   sscanf(argv[1], "%ld", &lower);
   sscanf(argv[2], "%ld", &upper);
+  mode = (argc > 3 ? argv[3] : "sieve");
+
+  if (strcmp(mode, "scaling") == 0) {
+    runScaling(lower, upper, argc > 4 ? argv[4] : "sieve", argc > 5 ? atoi(argv[5]) : 3,
+               argc > 6 ? argv[6] : "scaling.csv");
+    return 0;
+  }
+  if (strcmp(mode, "benchmark") == 0) {
+    runBenchmark();
+    return 0;
+  }
 
   printf("There are %d of threads in the sequential region. \n", omp_get_num_threads());
   printf("There are maximum %d of threads in the system. \n", omp_get_max_threads());
   printf("There are %d of processors in the system. \n", omp_get_num_procs());
   double start = omp_get_wtime();
-  long sum=0; 
+  __int128 sum=0; 
 	
 	printf("There are %d threads in the parallel region and thread no %d. \n", omp_get_num_threads(),omp_get_thread_num());
 
-	sum = sumTotient(lower, upper);
-
-	printf("C: Sum of Totients  between [%ld..%ld] is %ld\n",
-         lower, upper, sum);
+	if (strcmp(mode, "naive") == 0) {
+		printf("euler kernel: %s\n", totientEulerKernelName());
+		sum = sumTotient(lower, upper);
+	}
+	else if (strcmp(mode, "cache") == 0)
+		sum = cachedSumTotient(lower, upper, argc > 4 ? argv[4] : "totient.cache");
+	else if (strcmp(mode, "phi") == 0)
+		sum = totientSumRange(lower, upper);
+	else
+		sum = totientSieveSum(lower, upper);
+
+	printf("C: Sum of Totients  between [%ld..%ld] is %s\n",
+         lower, upper, totientFormat(sum, digits));
 
 	double stop = omp_get_wtime();
  	double exectime = stop - start;
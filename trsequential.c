@@ -1,6 +1,13 @@
 // TotientRance.c - Sequential Euler Totient Function (C Version)
 // compile: gcc -Wall -O -o TotientRange TotientRange.c
-// run:     ./TotientRange lower_num uppper_num
+// run:     ./TotientRange lower_num uppper_num [naive|sieve|phi|spf [file]|cache [file]]
+//          sieve (the default) uses the segmented sieve in totient.c,
+//          naive the gcd per pair below, phi the sub-linear
+//          Phi(upper) - Phi(lower-1) for ranges up to 1e12, spf one
+//          point query per n against the smallest-prime-factor table in
+//          spf.c, mapped from file when that covers upper, cache the
+//          prefix sums kept in file (totient.cache) by totcache.c
+//          ./TotientRange 0 0 benchmark times single euler(n) calls
 
 // Greg Michaelson 14/10/2003
 // Patrick Maier   29/01/2010 [enforced ANSI C compliance]
@@ -11,21 +18,22 @@
 
 #include <omp.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
+#include "totient.h"
+#include "totcache.h"
+#include "spf.h"
+
 // hcf x 0 = x
 // hcf x y = hcf y (rem x y)
+//
+// computed with Stein's binary gcd (totientGcd in totient.c): shifts by
+// the trailing zero count instead of 64 bit divisions
 
 long hcf(long x, long y)
 {
-  long t;
-
-  while (y != 0) {
-    t = x % y;
-    x = y;
-    y = t;
-  }
-  return x;
+  return (long) totientGcd(x, y);
 }
 
 
@@ -38,16 +46,13 @@ int relprime(long x, long y)
 
 
 // euler n = length (filter (relprime n) [1 .. n-1])
+//
+// totientEulerGcd tests 16 (AVX-512) or 8 (AVX2) values of i at once
+// with the binary gcd, chosen at runtime; otherwise a scalar loop
 
 long euler(long n)
 {
-  long length, i;
-
-  length = 0;
-  for (i = 1; i < n; i++)
-    if (relprime(n, i))
-      length++;
-  return length;
+  return totientEulerGcd(n);
 }
 
 
@@ -64,23 +69,84 @@ long sumTotient(long lower, long upper)
 }
 
 
+// sumTotient as upper-lower+1 independent euler(n) queries against the
+// smallest-prime-factor table
+
+__int128 spfSumTotient(long lower, long upper, const char *path)
+{
+  spf_table t;
+  __int128 sum = 0;
+  double start, stop;
+  long i;
+
+  start = omp_get_wtime();
+  if (path == NULL || spfOpen(path, &t) != 0 || t.limit < upper) {
+    if (path != NULL && t.mapped)
+      spfClose(&t);
+    if (spfCreate(upper, path, &t) != 0) {
+      perror("spfCreate");
+      return -1;
+    }
+    printf("spf table up to %ld built", t.limit);
+  } else {
+    printf("spf table up to %ld mapped", t.limit);
+  }
+  stop = omp_get_wtime();
+  printf(" in %f s\n", stop - start);
+
+  if (lower < 0)
+    lower = 0;
+  start = omp_get_wtime();
+  for (i = lower; i <= upper; i++)
+    sum += spfEuler(&t, i);
+  stop = omp_get_wtime();
+  if (upper >= lower)
+    printf("%f us per euler(n)\n", (stop - start) * 1e6 / (upper - lower + 1));
+
+  spfClose(&t);
+  return sum;
+}
+
+
+// sumTotient from the persistent prefix sums, extending them as needed
+
+__int128 cachedSumTotient(long lower, long upper, const char *path)
+{
+  totcache c;
+  __int128 sum;
+
+  if (totcacheOpen(path, 0, &c) != 0) {
+    perror(path);
+    return totientSieveSum(lower, upper);
+  }
+  printf("cache %s: block %ld, %ld checkpoints\n", path, c.block, c.count);
+  sum = totcacheRange(&c, lower, upper);
+  totcacheClose(&c);
+  return sum;
+}
+
+
+// time of single euler(n) calls, wall-clock: clock() adds up the CPU
+// time of all threads
+
 void runBenchmark()
 {
-  clock_t start, end;
-  double time_taken;
+  double start, end;
 
   for (long i = 1; i < 1000000 ; i = i + 100000) {
-    start = clock();
+    start = omp_get_wtime();
     euler(i);
-    end = clock();
-    time_taken = ((double) (end - start)) / CLOCKS_PER_SEC;
-    printf("euler(%lu) = %f seconds\n", i, time_taken);
+    end = omp_get_wtime();
+    printf("euler(%lu) = %f seconds\n", i, end - start);
   }   
 }
 
 int main(int argc, char ** argv)
 {
   long lower, upper;
+  const char *mode = (argc > 3 ? argv[3] : "sieve");
+  __int128 sum;
+  char digits[48];
 
 //  if (argc != 3) {
 //    printf("not 2 arguments\n");
@@ -90,8 +156,24 @@ int main(int argc, char ** argv)
   sscanf(argv[1], "%ld", &lower);
   sscanf(argv[2], "%ld", &upper);
 //  double start = omp_get_wtime();
-	printf("C: Sum of Totients  between [%ld..%ld] is %ld\n",
-         lower, upper, sumTotient(lower, upper));
+  if (strcmp(mode, "benchmark") == 0) {
+    runBenchmark();
+    return 0;
+  }
+  if (strcmp(mode, "naive") == 0) {
+    printf("euler kernel: %s\n", totientEulerKernelName());
+    sum = sumTotient(lower, upper);
+  }
+  else if (strcmp(mode, "phi") == 0)
+    sum = totientSumRange(lower, upper);
+  else if (strcmp(mode, "cache") == 0)
+    sum = cachedSumTotient(lower, upper, argc > 4 ? argv[4] : "totient.cache");
+  else if (strcmp(mode, "spf") == 0)
+    sum = spfSumTotient(lower, upper, argc > 4 ? argv[4] : NULL);
+  else
+    sum = totientSieveSum(lower, upper);
+	printf("C: Sum of Totients  between [%ld..%ld] is %s\n",
+         lower, upper, totientFormat(sum, digits));
 //  double stop = omp_get_wtime();
 //  double exectime = stop - start;
 //	printf("Execution time: %1f\n",exectime);	
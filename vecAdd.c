@@ -11,22 +11,33 @@
 #else
 #include <CL/cl.h>
 #endif
+
+#include "reduce.h"
+#include "vload.h"
  
-// OpenCL kernel. Each work item takes care of one element of c
+// OpenCL kernel, the same as vecAdd.cl. Built with -DW=n, n the device's
+// preferred double vector width (see vload.h); each work item strides
+// over c, W elements at a time, and the n % W tail is done as scalars
 const char *kernelSource =
   "#pragma OPENCL EXTENSION cl_khr_fp64 : enable                    \n"
+  VLOAD_SOURCE
   "__kernel void vecAdd(  __global double *a,                       \n"
   "                       __global double *b,                       \n"
   "                       __global double *c,                       \n"
   "                       const unsigned int n)                    \n"
   "{                                                               \n"
-  "    //Get our global thread ID                                  \n"
-  "    int id = get_global_id(0);                                  \n"
+  "    size_t stride = get_global_size(0);                         \n"
+  "    size_t nv = n / W;                                          \n"
+  "    size_t i;                                                   \n"
   "                                                                \n"
-  "    //Make sure we do not go out of bounds                      \n"
-  "    if (id < n)                                                 \n"
-  "        c[id] = a[id] + b[id];                                  \n"
+  "    for (i = get_global_id(0); i < nv; i += stride)             \n"
+  "        VSTORE(VLOAD(i, a) + VLOAD(i, b), i, c);                \n"
+  "    for (i = nv*W + get_global_id(0); i < n; i += stride)       \n"
+  "        c[i] = a[i] + b[i];                                     \n"
   "}                                                               \n";
+
+// A few work-groups per compute unit, the kernel loops over the rest
+#define GROUPS_PER_UNIT 8
  
 int main( int argc, char* argv[] )
 {
@@ -36,8 +47,6 @@ int main( int argc, char* argv[] )
     // Host input vectors
     double *h_a;
     double *h_b;
-    // Host output vector
-    double *h_c;
  
     // Device input buffers
     cl_mem d_a;
@@ -58,7 +67,6 @@ int main( int argc, char* argv[] )
     // Allocate memory for each vector on host
     h_a = (double*)malloc(bytes);
     h_b = (double*)malloc(bytes);
-    h_c = (double*)malloc(bytes);
  
     // Initialize vectors on host
     int i;
@@ -68,21 +76,33 @@ int main( int argc, char* argv[] )
         h_b[i] = cosf(i)*cosf(i);
     }
  
-    size_t globalSize, localSize;
+    size_t globalSize, localSize, groups;
+    cl_uint width = 1, computeUnits = 1;
+    char options[32];
     cl_int err;
  
     // Number of work items in each local work group
     localSize = 64;
  
-    // Number of total work items - localSize must be devisor
-    globalSize = ceil(n/(float)localSize)*localSize;
- 
     // Bind to platform
     err = clGetPlatformIDs(1, &cpPlatform, NULL);
  
     // Get ID for the device
     err = clGetDeviceIDs(cpPlatform, CL_DEVICE_TYPE_DEFAULT, 1, &device_id, NULL);
  
+    // Vector width of the kernel
+    width = vloadWidth(device_id, CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE);
+    clGetDeviceInfo(device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    sprintf(options, "-DW=%u", width);
+ 
+    // Enough work groups to fill the device, no more than the vectors need
+    groups = (n / width + localSize - 1) / localSize;
+    if (groups > computeUnits * GROUPS_PER_UNIT)
+        groups = computeUnits * GROUPS_PER_UNIT;
+    if (groups == 0)
+        groups = 1;
+    globalSize = groups * localSize;
+ 
     // Create a context  
     context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
  
@@ -96,7 +116,7 @@ int main( int argc, char* argv[] )
                             (const char **) & kernelSource, NULL, &err);
  
     // Build the program executable 
-    clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    clBuildProgram(program, 0, NULL, options, NULL, NULL);
  
     // Create the compute kernel in the program we wish to run
     kernel = clCreateKernel(program, "vecAdd", &err);
@@ -118,24 +138,30 @@ int main( int argc, char* argv[] )
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_c);
     err |= clSetKernelArg(kernel, 3, sizeof(unsigned int), &n);
  
-    // Execute the kernel over the entire range of the data set  
+    // Execute the kernel, each work item striding over the data set
     err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &globalSize, &localSize,
                                                               0, NULL, NULL);
  
     // Wait for the command queue to get serviced before reading back results
     clFinish(queue);
  
-    // Read the results from the device
-    clEnqueueReadBuffer(queue, d_c, CL_TRUE, 0,
-                                bytes, h_c, 0, NULL, NULL );
- 
-    //Sum up vector c and print result divided by n, this should equal 1 within error
+    //Sum up vector c on the device and print result divided by n, this
+    //should equal 1 within error; only the sum is read back
     double sum = 0;
-    for(i=0; i<n; i++)
-        sum += h_c[i];
+    reduceSetDevice(context, device_id, queue);
+    err = reduce(REDUCE_DOUBLE, REDUCE_SUM, NULL, d_c, NULL, n, &sum, NULL);
+    if (err != CL_SUCCESS)
+        printf("reduction failed: %d\n", err);
     printf("final result: %f\n", sum/n);
  
+    //Same with the addition fused into the reduction, c is not needed
+    err = reduce(REDUCE_DOUBLE, REDUCE_SUM, "x+y", d_a, d_b, n, &sum, NULL);
+    if (err != CL_SUCCESS)
+        printf("reduction failed: %d\n", err);
+    printf("fused result: %f\n", sum/n);
+ 
     // release OpenCL resources
+    reduceRelease();
     clReleaseMemObject(d_a);
     clReleaseMemObject(d_b);
     clReleaseMemObject(d_c);
@@ -147,7 +173,6 @@ int main( int argc, char* argv[] )
     //release host memory
     free(h_a);
     free(h_b);
-    free(h_c);
  
     return 0;
 }
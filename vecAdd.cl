@@ -1,14 +1,19 @@
-// OpenCL kernel. Each work item takes care of one element of c
+// OpenCL kernel. Build with -DW=n, n the device's preferred double vector
+// width, after VLOAD_SOURCE from vload.h; each work item strides over c,
+// W elements at a time, and the n % W tail is done as scalars
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
 __kernel void vecAdd(  __global double *a,                    
                        __global double *b,                   
                        __global double *c,                     
                        const unsigned int n)                   
 {                                                             
-    //Get our global thread ID                                
-    int id = get_global_id(0);                                
-                                                               
-    //Make sure we do not go out of bounds                    
-    if (id < n)                                                
-        c[id] = a[id] + b[id];                                 
+    size_t stride = get_global_size(0);
+    size_t nv = n / W;
+    size_t i;
+
+    for (i = get_global_id(0); i < nv; i += stride)
+        VSTORE(VLOAD(i, a) + VLOAD(i, b), i, c);
+    for (i = nv*W + get_global_id(0); i < n; i += stride)
+        c[i] = a[i] + b[i];
 }                                                              
-  
\ No newline at end of file
@@ -1,7 +1,19 @@
+// Build with -DW=n, n the device's preferred float vector width (1, 2, 4,
+// 8 or 16), after VLOAD_SOURCE from vload.h. Work-items stride over the
+// data, W elements at a time, so a fixed number of work-groups covers any
+// SIZE; the SIZE % W tail is done as scalars.
+
 __kernel void addVectors(__global const float *a, 
 	__global const float *b,
-	__global float *c) {
+	__global float *c,
+	const unsigned int n) {
 		
-		int gid = get_global_id(0);
-		c[gid] = a[gid] + b[gid];
+		size_t stride = get_global_size(0);
+		size_t nv = n / W;
+		size_t i;
+
+		for (i = get_global_id(0); i < nv; i += stride)
+			VSTORE(VLOAD(i, a) + VLOAD(i, b), i, c);
+		for (i = nv*W + get_global_id(0); i < n; i += stride)
+			c[i] = a[i] + b[i];
 	}
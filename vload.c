@@ -0,0 +1,14 @@
+#include "vload.h"
+
+cl_uint vloadWidth( cl_device_id device, cl_device_info param)
+{
+  cl_uint w = 1;
+
+  clGetDeviceInfo (device, param, sizeof (cl_uint), &w, NULL);
+  /* vloadn/vstoren exist for 2, 4, 8 and 16 */
+  if (w >= 16) return 16;
+  if (w >= 8) return 8;
+  if (w >= 4) return 4;
+  if (w >= 2) return 2;
+  return 1;
+}
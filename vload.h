@@ -0,0 +1,33 @@
+#ifndef VLOAD_H
+#define VLOAD_H
+
+#ifdef OSX
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+/* W-wide loads and stores for the grid-stride kernels. Put VLOAD_SOURCE
+ * in front of a kernel built with -DW=n (or after a "#define W n" line):
+ * VLOAD(i, p) and VSTORE(v, i, p) are vloadn/vstoren for W > 1 and plain
+ * element accesses for W == 1.  */
+#define VLOAD_SOURCE                        \
+  "#ifndef W\n"                             \
+  "#define W 1\n"                           \
+  "#endif\n"                                \
+  "#define CAT_(a, b) a ## b\n"             \
+  "#define CAT(a, b) CAT_(a, b)\n"          \
+  "#if W > 1\n"                             \
+  "#define VLOAD CAT(vload, W)\n"           \
+  "#define VSTORE CAT(vstore, W)\n"         \
+  "#else\n"                                 \
+  "#define VLOAD(i, p) (p)[i]\n"            \
+  "#define VSTORE(v, i, p) (p)[i] = (v)\n"  \
+  "#endif\n"
+
+/* The device's preferred vector width for param
+ * (CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, ..._DOUBLE, ...) as a W for
+ * VLOAD_SOURCE: rounded down to 16, 8, 4 or 2, or 1.  */
+cl_uint vloadWidth( cl_device_id device, cl_device_info param);
+
+#endif